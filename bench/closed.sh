@@ -0,0 +1,38 @@
+#!/bin/sh
+# Time bench/closed.cow for growing n, in the interpreter and compiled.
+# Loops that run in closed form take the same time whatever n is.
+#
+# usage: bench/closed.sh [n ...]
+
+set -e
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+prog=$root/bench/closed.cow
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+g++ -O2 -DNO_GREETINGS -o cow "$root/source/cow.cpp"
+g++ -O2 -o cowcomp "$root/source/cowcomp.cpp"
+./cowcomp -o closed.out "$prog" > /dev/null
+
+now() { date +%s.%N; }
+since() { echo "$(now) $1" | awk '{ printf "%.3f", $1 - $2 }'; }
+
+[ $# -gt 0 ] || set -- 1000 1000000 1000000000
+
+for n in "$@"; do
+    printf '%s\n%s\n' $n $n > in.txt
+
+    start=$(now)
+    ./cow "$prog" < in.txt > cow.txt
+    cow=$(since $start)
+
+    start=$(now)
+    ./closed.out < in.txt > comp.txt
+    comp=$(since $start)
+
+    echo "n=$n: interpreter ${cow}s, compiled ${comp}s"
+    cmp -s cow.txt comp.txt || echo "outputs differ!"
+done
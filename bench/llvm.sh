@@ -0,0 +1,40 @@
+#!/bin/sh
+# Compare the C++ backend (g++) with the LLVM IR backend (-llvm).  Reports
+# compile time and run time for each.
+#
+# usage: bench/llvm.sh [program.cow]
+
+set -e
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+prog=${1:-$root/bench/loops.cow}
+case $prog in
+    /*) ;;
+    *) prog=$(pwd)/$prog ;;
+esac
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+g++ -O2 -o cowcomp "$root/source/cowcomp.cpp"
+
+now() { date +%s.%N; }
+since() { echo "$(now) $1" | awk '{ printf "%.2f", $1 - $2 }'; }
+
+for mode in cpp llvm; do
+    flag=
+    [ $mode = llvm ] && flag=-llvm
+
+    start=$(now)
+    ./cowcomp $flag -o $mode.out "$prog" > /dev/null
+    build=$(since $start)
+
+    start=$(now)
+    ./$mode.out < /dev/null > $mode.txt
+    run=$(since $start)
+
+    echo "$mode: compile ${build}s, run ${run}s"
+done
+
+cmp -s cpp.txt llvm.txt || echo "outputs differ!"
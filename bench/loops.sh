@@ -0,0 +1,40 @@
+#!/bin/sh
+# Compare the two ways cowcomp can emit loops: while loops (the default)
+# and labels with gotos (-goto).  Reports C++ compile time and run time.
+#
+# usage: bench/loops.sh [program.cow]
+
+set -e
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+prog=${1:-$root/bench/loops.cow}
+case $prog in
+    /*) ;;
+    *) prog=$(pwd)/$prog ;;
+esac
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+g++ -O2 -o cowcomp "$root/source/cowcomp.cpp"
+
+now() { date +%s.%N; }
+since() { echo "$(now) $1" | awk '{ printf "%.2f", $1 - $2 }'; }
+
+for mode in goto while; do
+    flag=
+    [ $mode = goto ] && flag=-goto
+
+    start=$(now)
+    ./cowcomp $flag -o $mode.out "$prog" > /dev/null
+    build=$(since $start)
+
+    start=$(now)
+    ./$mode.out < /dev/null > $mode.txt
+    run=$(since $start)
+
+    echo "$mode: compile ${build}s, run ${run}s"
+done
+
+cmp -s goto.txt while.txt || echo "outputs differ!"
@@ -0,0 +1,55 @@
+#!/bin/sh
+# Time bench/mmm.cow, which runs the DDX mmm in its inner loop, in the DDX
+# interpreter from before mmm shared the register without branches (old),
+# built with the scalar code and with AVX2, run with -jit, and compiled
+# with cowcomp -ddx.  old needs a git checkout.
+#
+# usage: bench/mmm.sh [passes]
+
+set -e
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+prog=$root/bench/mmm.cow
+passes=${1:-2000000}
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+# the last commit with the if/else chain in mmm.
+old=2eb31f0
+
+modes="scalar avx2 jit cpp"
+if git -C "$root" show $old:ddx/cow.cpp > old.cpp 2> /dev/null; then
+    g++ -O2 -o old old.cpp
+    modes="old $modes"
+else
+    echo "old: skipped, $old is not in this checkout"
+fi
+g++ -O2 -DNO_GREETINGS -o scalar "$root/ddx/cow.cpp"
+g++ -O2 -DNO_GREETINGS -mavx2 -o avx2 "$root/ddx/cow.cpp"
+g++ -O2 -o cowcomp "$root/source/cowcomp.cpp"
+./cowcomp -ddx -o cpp.out "$prog" > /dev/null
+
+now() { date +%s.%N; }
+since() { echo "$(now) $1" | awk '{ printf "%.2f", $1 - $2 }'; }
+
+echo $passes > in.txt
+
+for mode in $modes; do
+    run="./$mode $prog"
+    [ $mode = jit ] && run="./scalar -jit $prog"
+    [ $mode = cpp ] && run=./cpp.out
+
+    start=$(now)
+    $run < in.txt > $mode.txt
+    echo "$mode: $(since $start)s"
+done
+
+cmp -s scalar.txt avx2.txt && cmp -s scalar.txt jit.txt && cmp -s scalar.txt cpp.txt || echo "outputs differ!"
+
+# old always greets.
+if [ -f old.txt ]; then
+    grep -v -e '^Welcome to COW!$' -e '^Executing \[' -e '^Done\.$' old.txt | sed '/^$/d' > old.cut
+    sed '/^$/d' scalar.txt | cmp -s - old.cut || echo "old output differs!"
+fi
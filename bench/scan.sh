@@ -0,0 +1,38 @@
+#!/bin/sh
+# Time bench/scan.cow, which runs scan loops (MOO moO moo, MOO mOo moo)
+# over a long stretch of nonzero cells, in the interpreter and compiled
+# with each backend.
+#
+# usage: bench/scan.sh [cells] [passes]
+
+set -e
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+prog=$root/bench/scan.cow
+cells=${1:-20000}
+passes=${2:-20000}
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+g++ -O2 -DNO_GREETINGS -o cow "$root/source/cow.cpp"
+g++ -O2 -o cowcomp "$root/source/cowcomp.cpp"
+./cowcomp -o cpp.out "$prog" > /dev/null
+./cowcomp -llvm -o llvm.out "$prog" > /dev/null
+
+now() { date +%s.%N; }
+since() { echo "$(now) $1" | awk '{ printf "%.2f", $1 - $2 }'; }
+
+printf '%s\n%s\n' $cells $passes > in.txt
+
+for mode in cow cpp llvm; do
+    run=./$mode.out
+    [ $mode = cow ] && run="./cow $prog"
+
+    start=$(now)
+    $run < in.txt > $mode.txt
+    echo "$mode: $(since $start)s"
+done
+
+cmp -s cow.txt cpp.txt && cmp -s cow.txt llvm.txt || echo "outputs differ!"
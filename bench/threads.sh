@@ -0,0 +1,37 @@
+#!/bin/sh
+# Time bench/mmm.cow with thousands of stomachs in the interpreter, with
+# the commands on all stomachs split over 1, 2, 4 ... threads.  There is
+# no gain past the number of cores.
+#
+# usage: bench/threads.sh [stomachs] [passes] [max threads]
+
+set -e
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+prog=$root/bench/mmm.cow
+stomachs=${1:-65536}
+passes=${2:-2000}
+max=${3:-$(nproc)}
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+g++ -O2 -DNO_GREETINGS -mavx2 -o cow "$root/source/cow.cpp"
+
+now() { date +%s.%N; }
+since() { echo "$(now) $1" | awk '{ printf "%.2f", $1 - $2 }'; }
+
+echo $passes > in.txt
+
+threads=1
+while :; do
+    start=$(now)
+    ./cow -stomachs $stomachs -threads $threads "$prog" < in.txt > $threads.txt
+    echo "$threads threads: $(since $start)s"
+    cmp -s 1.txt $threads.txt || echo "outputs differ!"
+
+    [ $threads -ge $max ] && break
+    threads=$((threads * 2))
+    [ $threads -gt $max ] && threads=$max
+done
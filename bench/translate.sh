@@ -0,0 +1,34 @@
+#!/bin/sh
+# Measure how fast cowcomp translates COW into C++, in instructions per
+# second.  Only translation is timed; the C++ compiler is not run.
+#
+# usage: bench/translate.sh [instructions]
+
+set -e
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+size=${1:-1000000}
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+g++ -O2 -o cowcomp "$root/source/cowcomp.cpp"
+
+# a mix of every command in small nested loops, with mOO sprinkled in.
+awk -v size=$size 'BEGIN {
+    srand( 1 );
+    split( "mOo moO Moo MOo MoO OOO MMM OOM oom mOO", op, " " );
+    n = 0;
+    while( n < size ) {
+        printf "MoO MOO ";
+        for( i = 0; i < 20; i++ )
+            printf "%s ", op[int( rand() * 10 ) + 1];
+        printf "MOO MOo moO moo MOo moo\n";
+        n += 28;
+    }
+}' > big.cow
+
+for run in 1 2 3; do
+    ./cowcomp -S -time big.cow | grep Translated
+done
@@ -0,0 +1,59 @@
+#!/bin/sh
+# Time a generated program whose loop adds to a wide window of cells with
+# long runs of moves and adds, in the interpreter and compiled.  Copying
+# cell 1 to cell 2 with MMM keeps the loop from running in closed form.
+#
+# usage: bench/wide.sh [passes] [cells]
+
+set -e
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+passes=${1:-1000000}
+cells=${2:-32}
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+
+g++ -O2 -DNO_GREETINGS -o cow "$root/source/cow.cpp"
+g++ -O2 -o cowcomp "$root/source/cowcomp.cpp"
+
+# cell 0 counts the passes; each pass adds a random vector to cells 1 on,
+# then everything is printed.
+awk -v cells=$cells 'BEGIN {
+    srand( 1 );
+    print "oom MOO moO MMM moO MMM mOo mOo";
+    for( run = 0; run < 4; run++ ) {
+        for( c = 1; c <= cells; c++ ) {
+            printf "moO ";
+            k = int( rand() * 7 ) - 3;
+            for( i = 0; i < k; i++ ) printf "MoO ";
+            for( i = 0; i > k; i-- ) printf "MOo ";
+        }
+        for( c = 1; c <= cells; c++ ) printf "mOo ";
+        print "";
+    }
+    print "MOo moo";
+    for( c = 1; c <= cells; c++ ) printf "moO OOM ";
+    print "";
+}' > wide.cow
+
+now() { date +%s.%N; }
+since() { echo "$(now) $1" | awk '{ printf "%.2f", $1 - $2 }'; }
+
+echo $passes > in.txt
+
+start=$(now)
+./cowcomp -o wide.out wide.cow > /dev/null
+build=$(since $start)
+
+start=$(now)
+./wide.out < in.txt > comp.txt
+comp=$(since $start)
+
+start=$(now)
+./cow wide.cow < in.txt > cow.txt
+cow=$(since $start)
+
+echo "interpreter ${cow}s, compiled ${comp}s (compile ${build}s)"
+cmp -s cow.txt comp.txt || echo "outputs differ!"
@@ -9,6 +9,13 @@
 #include <stdio.h>
 #include <cstdlib>
 #include <cstring>
+#include <pthread.h>
+#include <time.h>
+#include <signal.h>
+#ifdef __x86_64__
+#include <sys/mman.h>
+#endif
+#include "cowopt.h"
 
 typedef std::vector<int> mem_t;
 mem_t program;
@@ -16,6 +23,25 @@ mem_t memory;
 mem_t::iterator mem_pos;
 mem_t::iterator prog_pos;
 
+// the same program with COW_LEFT, COW_RIGHT and COW_ADDS inside regions.
+// A region is run from here when the check on entry says the tape is big
+// enough, from program otherwise.
+mem_t fast;
+mem_t* code = &program;
+std::vector<cow_region> regions;
+
+// loops run in closed form, in the unchecked copy.
+std::vector<cow_counted> counted;
+
+// what each COW_ADDS in the unchecked copy does.
+std::vector<cow_block> blocks;
+
+// how far each pass of a loop that only moves goes, or 0.
+std::vector<int> scans;
+
+// set by moo when it jumps back to its MOO, which is no loop entry.
+bool looping = false;
+
 int register_val;
 bool has_register_val = false;
 
@@ -33,23 +59,626 @@ void quit( bool error )
     exit(0);
 }
 
-bool exec( int instruction )
+// the memory models exec() runs on.  cow_tape is COW's one tape.
+struct cow_tape
+{
+    static int& cell()
+    {
+        return *mem_pos;
+    }
+
+    static void start()
+    {
+        memory.push_back( 0 );
+        mem_pos = memory.begin();
+    }
+
+    // mOo: false off the start of the tape.
+    static bool left()
+    {
+        if( mem_pos == memory.begin() )
+            return false;
+        mem_pos--;
+        return true;
+    }
+
+    // moO
+    static void right()
+    {
+        mem_pos++;
+        if( mem_pos == memory.end() )
+        {
+            memory.push_back(0);
+            mem_pos = memory.end();
+            mem_pos--;
+        }
+    }
+
+    // the commands only some memory models have.
+    static bool command( int )
+    {
+        return false;
+    }
+
+    // the current stomach's tape for the regions, scans and closed form
+    // loops: cell i is base()[i * pitch()], of cells(), and the pointer is
+    // at at().  move() doesn't check the ends, and grow() makes the tape
+    // at least that many cells long.
+    static int* base()
+    {
+        return &memory[0];
+    }
+
+    static int pitch()
+    {
+        return 1;
+    }
+
+    static long cells()
+    {
+        return memory.size();
+    }
+
+    static long at()
+    {
+        return mem_pos - memory.begin();
+    }
+
+    static void move( long d )
+    {
+        mem_pos += d;
+    }
+
+    static void grow( long n )
+    {
+        long pos = at();
+        memory.resize( n, 0 );
+        mem_pos = memory.begin() + pos;
+    }
+
+    // called for every command run, for -profile.
+    static void count( int )
+    {
+    }
+
+    // where to carry on after running the program as machine code, which
+    // is left to cowcomp for plain COW.
+    static int jit()
+    {
+        return 0;
+    }
+};
+
+// the Distributed Digestion eXtensions (see ddx/ddx.txt), with -ddx:
+// commands 12 to 19 and num_stomachs tapes.  Built with COW_DDX they are
+// on without -ddx.
+#ifndef COW_DDX
+#define COW_DDX false
+#endif
+bool ddx = COW_DDX;
+bool profile = false;	// -profile, see ddx_profile.
+volatile sig_atomic_t profile_stopped;	// ^C under -profile.
+
+// the tapes lie side by side: cell j of every stomach is in row j, which is
+// a whole number of vectors of STOMACH_LANES ints.  When all stomachs are
+// at the same row their cells are a few vectors.  Lanes past the last
+// stomach stay 0.
+#define STOMACH_LANES 8
+
+// the code is built for a few stomach counts, where loops over the
+// stomachs have a fixed length.  N is the count, or 0 for any other count,
+// which is then num_stomachs.
+int num_stomachs = 7;
+int row_width;
+
+template<int N> inline int stomachs()
+{
+    return N ? N : num_stomachs;
+}
+
+template<int N> inline int width()
+{
+    return N ? (N + STOMACH_LANES - 1) / STOMACH_LANES * STOMACH_LANES : row_width;
+}
+
+// stomach i is at row row_pos + mem_poses[i] of memory.  Mostly all
+// stomachs are at the same row: then they are in lockstep, every
+// mem_poses[i] is 0 and moving them all is one change to row_pos.
+int row_pos;
+std::vector<int> mem_poses;
+int low, high;	// the least and greatest of mem_poses.
+bool lockstep = true;
+int stomach;
+
+// a stomach moving on its own only changes its own mem_poses[], and low,
+// high and lockstep are found again when a command on all stomachs needs
+// them.
+bool settled = true;
+
+inline int row_of( int i )
+{
+    return row_pos + mem_poses[i];
+}
+
+// the current cell of stomach i.
+template<int N> inline int& cell( int i )
+{
+    return memory[row_of( i ) * width<N>() + i];
+}
+
+// the current cells of all stomachs, or NULL if they are not in one row.
+template<int N> int* row()
+{
+    return lockstep ? &memory[row_pos * width<N>()] : NULL;
+}
+
+// after stomachs have moved on their own: find the spread again, and go
+// back to lockstep when it has closed.
+template<int N> void settle()
+{
+    if( settled )
+        return;
+    settled = true;
+
+    low = high = mem_poses[0];
+    for( int i=1; i<stomachs<N>(); ++i )
+    {
+        if( mem_poses[i] < low )
+            low = mem_poses[i];
+        if( mem_poses[i] > high )
+            high = mem_poses[i];
+    }
+
+    lockstep = low == high;
+    if( lockstep )
+    {
+        row_pos += low;
+        for( int i=0; i<stomachs<N>(); ++i )
+            mem_poses[i] = 0;
+        low = high = 0;
+    }
+}
+
+#ifdef __AVX2__
+// all ones in the lanes of the vector at k that are stomachs.
+template<int N> inline __m256i lanes( int k )
+{
+    return _mm256_cmpgt_epi32( _mm256_set1_epi32( stomachs<N>() - k ),
+                               _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ) );
+}
+
+// the sum of the lanes of v.
+inline int hsum( __m256i v )
+{
+    __m128i s = _mm_add_epi32( _mm256_castsi256_si128( v ), _mm256_extracti128_si256( v, 1 ) );
+    s = _mm_add_epi32( s, _mm_shuffle_epi32( s, 0x4e ) );
+    s = _mm_add_epi32( s, _mm_shuffle_epi32( s, 0xb1 ) );
+    return _mm_cvtsi128_si32( s );
+}
+#endif
+
+// add d to the current cells of stomachs from to to.  from is a multiple
+// of STOMACH_LANES.
+template<int N> void add_cells( int d, int from, int to )
+{
+#ifdef __AVX2__
+    if( int* r = row<N>() )
+    {
+        for( int k=from; k<to; k+=STOMACH_LANES )
+        {
+            __m256i v = _mm256_loadu_si256( (__m256i*)(r + k) );
+            v = _mm256_add_epi32( v, _mm256_and_si256( _mm256_set1_epi32( d ), lanes<N>( k ) ) );
+            _mm256_storeu_si256( (__m256i*)(r + k), v );
+        }
+        return;
+    }
+#endif
+    for( int i=from; i<to; ++i )
+        cell<N>(i) += d;
+}
+
+// set the current cells of stomachs from to to to value.
+template<int N> void fill_cells( int value, int from, int to )
+{
+#ifdef __AVX2__
+    if( int* r = row<N>() )
+    {
+        for( int k=from; k<to; k+=STOMACH_LANES )
+            _mm256_storeu_si256( (__m256i*)(r + k), _mm256_and_si256( _mm256_set1_epi32( value ), lanes<N>( k ) ) );
+        return;
+    }
+#endif
+    for( int i=from; i<to; ++i )
+        cell<N>(i) = value;
+}
+
+// the sum of the current cells of stomachs from to to, or of the ones
+// above 0 if positive.
+template<int N> unsigned sum_cells( bool positive, int from, int to )
+{
+#ifdef __AVX2__
+    if( int* r = row<N>() )
+    {
+        __m256i zero = _mm256_setzero_si256();
+        __m256i v = zero;
+        for( int k=from; k<to; k+=STOMACH_LANES )
+        {
+            __m256i c = _mm256_loadu_si256( (__m256i*)(r + k) );
+            v = _mm256_add_epi32( v, positive ? _mm256_max_epi32( c, zero ) : c );
+        }
+        return hsum( v );
+    }
+#endif
+    unsigned sum = 0;
+    for( int i=from; i<to; ++i )
+    {
+        int c = cell<N>(i);
+        sum += positive && c < 0 ? 0 : c;
+    }
+    return sum;
+}
+
+// the current cells of stomachs from to to become div times themselves if
+// above 0, mod times minus themselves if below.  There are no branches on
+// the cells.
+template<int N> void scale_cells( int div, unsigned mod, int from, int to )
+{
+#ifdef __AVX2__
+    if( int* r = row<N>() )
+    {
+        __m256i zero = _mm256_setzero_si256();
+        __m256i d = _mm256_set1_epi32( div );
+        __m256i m = _mm256_set1_epi32( mod );
+        for( int k=from; k<to; k+=STOMACH_LANES )
+        {
+            __m256i v = _mm256_loadu_si256( (__m256i*)(r + k) );
+            __m256i pos = _mm256_max_epi32( v, zero );
+            __m256i neg = _mm256_and_si256( _mm256_cmpgt_epi32( zero, v ), _mm256_sub_epi32( zero, v ) );
+            v = _mm256_add_epi32( _mm256_mullo_epi32( pos, d ), _mm256_mullo_epi32( neg, m ) );
+            _mm256_storeu_si256( (__m256i*)(r + k), v );
+        }
+        return;
+    }
+#endif
+    for( int i=from; i<to; ++i )
+    {
+        int& c = cell<N>(i);
+        c = (c > 0 ? (unsigned)c * div : 0) + (c < 0 ? (0u - c) * mod : 0);
+    }
+}
+
+// with -threads, thousands of stomachs are cut into slices of at least
+// STOMACH_GRAIN, and the commands on all stomachs run a slice on each
+// thread.  Thread 0 is the main one; the others wait at job_start for a
+// job and meet it again at job_done.
+#define STOMACH_GRAIN 2048
+int num_threads = 1;
+int slices = 1;
+pthread_barrier_t job_start, job_done;
+void (*job)( int slice );
+int job_value, job_div;
+unsigned job_mod;
+std::vector<unsigned> job_sums;	// what each slice of a sum came to.
+
+// where slice s starts, on a vector boundary.  Slice slices ends at the
+// last stomach.
+inline int slice_from( int s )
+{
+    if( s == slices )
+        return num_stomachs;
+    return (int)((long)num_stomachs * s / slices) / STOMACH_LANES * STOMACH_LANES;
+}
+
+void* worker( void* arg )
+{
+    int s = (int)(long)arg;
+    for( ;; )
+    {
+        pthread_barrier_wait( &job_start );
+        job( s );
+        pthread_barrier_wait( &job_done );
+    }
+    return NULL;
+}
+
+// run f on every slice, and wait for all of them.
+void run_slices( void (*f)( int ) )
+{
+    job = f;
+    pthread_barrier_wait( &job_start );
+    f( 0 );
+    pthread_barrier_wait( &job_done );
+}
+
+void start_threads()
+{
+    slices = num_stomachs / STOMACH_GRAIN;
+    if( slices > num_threads )
+        slices = num_threads;
+    if( slices <= 1 )
+    {
+        slices = 1;
+        return;
+    }
+
+    job_sums.resize( slices );
+    pthread_barrier_init( &job_start, NULL, slices );
+    pthread_barrier_init( &job_done, NULL, slices );
+
+    // ^C is left to the main thread, which may be waiting for input.
+    sigset_t block, old;
+    sigemptyset( &block );
+    sigaddset( &block, SIGINT );
+    pthread_sigmask( SIG_BLOCK, &block, &old );
+    for( long s = 1; s < slices; s++ )
+    {
+        pthread_t t;
+        if( pthread_create( &t, NULL, worker, (void*)s ) != 0 )
+        {
+            printf( "Cannot start thread %ld.\n", s );
+            exit( 1 );
+        }
+    }
+    pthread_sigmask( SIG_SETMASK, &old, NULL );
+}
+
+// the jobs, for any count of stomachs.
+void add_slice( int s )
+{
+    add_cells<0>( job_value, slice_from( s ), slice_from( s + 1 ) );
+}
+
+void fill_slice( int s )
+{
+    fill_cells<0>( job_value, slice_from( s ), slice_from( s + 1 ) );
+}
+
+void sum_slice( int s )
+{
+    job_sums[s] = sum_cells<0>( false, slice_from( s ), slice_from( s + 1 ) );
+}
+
+void weigh_slice( int s )
+{
+    job_sums[s] = sum_cells<0>( true, slice_from( s ), slice_from( s + 1 ) );
+}
+
+void scale_slice( int s )
+{
+    scale_cells<0>( job_div, job_mod, slice_from( s ), slice_from( s + 1 ) );
+}
+
+// the sum of the current cells of all stomachs, or of the ones above 0.
+// Slices are only used when the count is not built in.
+template<int N> unsigned sum_all( bool positive )
+{
+    if( N != 0 || slices == 1 )
+        return sum_cells<N>( positive, 0, stomachs<N>() );
+
+    run_slices( positive ? weigh_slice : sum_slice );
+    unsigned sum = 0;
+    for( int s=0; s<slices; ++s )
+        sum += job_sums[s];
+    return sum;
+}
+
+// add d to the current cell of every stomach.
+template<int N> void add_all( int d )
+{
+    if( N != 0 || slices == 1 )
+        add_cells<N>( d, 0, stomachs<N>() );
+    else
+    {
+        job_value = d;
+        run_slices( add_slice );
+    }
+}
+
+// set the current cell of every stomach to value.
+template<int N> void fill_all( int value )
+{
+    if( N != 0 || slices == 1 )
+        fill_cells<N>( value, 0, stomachs<N>() );
+    else
+    {
+        job_value = value;
+        run_slices( fill_slice );
+    }
+}
+
+// share value out over the current cells of all stomachs, the way mmm does
+// with a value in the register, with one division in all.
+template<int N> void share_all( int value )
+{
+    unsigned weight = sum_all<N>( true );
+    if( weight == 0 )
+    {
+        fill_all<N>( value );
+        return;
+    }
+
+    int div = value / (int)weight;
+    unsigned mod = value - div * (int)weight;
+    if( N != 0 || slices == 1 )
+        scale_cells<N>( div, mod, 0, stomachs<N>() );
+    else
+    {
+        job_div = div;
+        job_mod = mod;
+        run_slices( scale_slice );
+    }
+}
+
+// N stomachs, with commands 12 to 19 for them.
+template<int N> struct ddx_tape
+{
+    static int& cell()
+    {
+        return ::cell<N>( stomach );
+    }
+
+    static void start()
+    {
+        memory.resize( width<N>(), 0 );
+        row_pos = 0;
+        mem_poses.assign( stomachs<N>(), 0 );
+        low = high = 0;
+        lockstep = settled = true;
+        stomach = 0;
+    }
+
+    static bool left()
+    {
+        if( row_of( stomach ) == 0 )
+            return false;
+        mem_poses[stomach]--;
+        settled = false;
+        return true;
+    }
+
+    static void right()
+    {
+        mem_poses[stomach]++;
+        settled = false;
+        if( row_of( stomach ) * width<N>() == (int)memory.size() )
+            memory.resize( memory.size() + width<N>(), 0 );
+    }
+
+    static bool command( int instruction )
+    {
+        if( instruction >= 14 )
+            ::settle<N>();
+
+        switch( instruction )
+        {
+        // MMm
+        case 12:
+            {
+                stomach--; if(stomach < 0) stomach += stomachs<N>();
+                return true;
+            }
+
+        // MmM
+        case 13:
+            {
+                stomach++; if(stomach >= stomachs<N>()) stomach -= stomachs<N>();
+                return true;
+            }
+
+        // Oom
+        case 14:
+            if( row_pos + low == 0 )
+                quit( true );
+            else
+                row_pos--;
+            return true;
+
+        // oOm
+        case 15:
+            row_pos++;
+            if( (row_pos + high) * width<N>() == (int)memory.size() )
+                memory.resize( memory.size() + width<N>(), 0 );
+            return true;
+
+        // OoM
+        case 16:
+            add_all<N>( -1 );
+            return true;
+
+        // oOM
+        case 17:
+            add_all<N>( 1 );
+            return true;
+
+        // ooo
+        case 18:
+            fill_all<N>( 0 );
+            return true;
+
+        // mmm
+        case 19:
+            if( has_register_val )
+                share_all<N>( register_val );
+            else
+                register_val = sum_all<N>( false );
+            has_register_val = !has_register_val;
+            return true;
+        }
+        return false;
+    }
+
+    // the current stomach's tape (see cow_tape): its column of memory.
+    static int* base()
+    {
+        return &memory[stomach];
+    }
+
+    static int pitch()
+    {
+        return width<N>();
+    }
+
+    static long cells()
+    {
+        return memory.size() / width<N>();
+    }
+
+    static long at()
+    {
+        return row_of( stomach );
+    }
+
+    static void move( long d )
+    {
+        mem_poses[stomach] += d;
+        settled = false;
+    }
+
+    static void grow( long n )
+    {
+        memory.resize( n * width<N>(), 0 );
+    }
+
+    static void count( int )
+    {
+    }
+
+    static void settle()
+    {
+        ::settle<N>();
+    }
+
+    static int jit();
+};
+
+// a character of input.  A read cut short by ^C under -profile ends the
+// program there, with the report, instead of waiting on.
+int read_char()
+{
+    int c = getchar();
+    if( c == EOF && profile_stopped )
+        exit( 1 );
+    return c;
+}
+
+template<class Tape> bool exec( int instruction )
 {
 //    printf( "EXEC: %d\n", instruction );
+    Tape::count( instruction );
 
     switch( instruction )
     {
     // moo
     case 0:
         {
-            if( prog_pos == program.begin() )
+            if( prog_pos == code->begin() )
                 quit( true );
 
             prog_pos--;	// skip previous command.
             int level = 1;
             while( level > 0 )
             {
-                if( prog_pos == program.begin() )
+                if( prog_pos == code->begin() )
                     break;
 
                 prog_pos--;
@@ -64,70 +693,64 @@ bool exec( int instruction )
             if( level != 0 )
                 quit(true);
 
-            return exec( *prog_pos );
+            looping = true;
+            return exec<Tape>( *prog_pos );
         }
     
     // mOo
     case 1:
-        if( mem_pos == memory.begin() )
+        if( !Tape::left() )
             quit( true );
-        else
-            mem_pos--;
         break;
 
     // moO
     case 2:
-        mem_pos++;
-        if( mem_pos == memory.end() )
-        {
-            memory.push_back(0);
-            mem_pos = memory.end();
-            mem_pos--;
-        }
+        Tape::right();
         break;
     
     // mOO    
     case 3:
-        if( (*mem_pos) == 3 )
+        if( Tape::cell() == 3 || Tape::cell() == COW_LEFT || Tape::cell() == COW_RIGHT || Tape::cell() == COW_ADDS )
             quit( false );
-        return exec(*mem_pos);
+        return exec<Tape>( Tape::cell() );
     
     // Moo
     case 4:
-        if( (*mem_pos) != 0 )
-            printf( "%c", *mem_pos );
+        if( Tape::cell() != 0 )
+            printf( "%c", Tape::cell() );
         else
         {
-            (*mem_pos) = getchar();
-            while( getchar() != '\n' );
+            Tape::cell() = read_char();
+            while( read_char() != '\n' );
         }
         break;
     
     // MOo
     case 5:
-        (*mem_pos)--;
+        Tape::cell()--;
         break;
     
     // MoO
     case 6:
-        (*mem_pos)++;
+        Tape::cell()++;
         break;
 
     // MOO
     case 7:
-        if( (*mem_pos) == 0 )
+        if( Tape::cell() == 0 )
         {
+            looping = false;
             int level = 1;
             int prev = 0;
             prog_pos++;	  // have to skip past next command when looking for next moo.
-            if( prog_pos == program.end() )
+            if( prog_pos == code->end() )
                 break;
             while( level > 0 )
             {
                 prev = *prog_pos;
                 prog_pos++;
                 
-                if( prog_pos == program.end() )
+                if( prog_pos == code->end() )
                     break;
                 
                 if( (*prog_pos) == 7 )
@@ -143,25 +766,63 @@ bool exec( int instruction )
             if( level != 0 )
                 quit( true );
         }
+        else
+        if( scans[prog_pos - code->begin()] != 0 )
+        {
+            // a loop that only moves: look for where it stops all at once.
+            // Off the end of the tape it carries on as usual.
+            int stride = scans[prog_pos - code->begin()];
+            long at = Tape::at();
+            if( cow_scan( Tape::base(), Tape::cells(), at, stride, Tape::pitch() ) )
+                prog_pos += (stride < 0 ? -stride : stride) + 1;
+            Tape::move( at - Tape::at() );
+            looping = false;
+        }
+        else
+        if( !looping )
+        {
+            int pos = prog_pos - code->begin();
+            if( regions[pos].end >= 0 )
+            {
+                // one check for the whole loop.  Growing the tape ahead of
+                // time changes nothing the program can see.
+                long at = Tape::at();
+                const cow_region& r = regions[pos];
+                code = &program;
+                if( at + r.lo >= 0 )
+                {
+                    if( at + r.hi >= Tape::cells() )
+                        Tape::grow( at + r.hi + 1 );
+                    code = &fast;
+                }
+                prog_pos = code->begin() + pos;
+            }
+
+            // counted loops are all in regions, so the tape reaches.
+            if( code == &fast && counted[pos].end >= 0 && cow_close( counted[pos], &Tape::cell(), Tape::pitch() ) )
+                prog_pos = code->begin() + counted[pos].end;
+        }
+        else
+            looping = false;
         break;
     
     // OOO
     case 8:
-        (*mem_pos) = 0;
+        Tape::cell() = 0;
         break;
 
     // MMM
     case 9:
         if( has_register_val )
-            (*mem_pos) = register_val;
+            Tape::cell() = register_val;
         else
-            register_val = (*mem_pos);
+            register_val = Tape::cell();
         has_register_val = !has_register_val;
         break;
 
     // OOM
     case 10:
-        printf( "%d\n", *mem_pos );
+        printf( "%d\n", Tape::cell() );
         break;
     
     // oom
@@ -171,7 +832,7 @@ bool exec( int instruction )
             int c = 0;
             while( c < sizeof(buf)-1 )
             {
-                buf[c] = getchar();
+                buf[c] = read_char();
                 c++;
                 buf[c] = 0;
                 
@@ -180,16 +841,36 @@ bool exec( int instruction )
             }
             // swallow, just in case.
             if( c == sizeof(buf) )
-                while( getchar() != '\n' );
+                while( read_char() != '\n' );
             
-            (*mem_pos) = atoi( buf );
+            Tape::cell() = atoi( buf );
 
             break;
         }
 
-    // bad stuff
+    // mOo and moO in a region
+    case COW_LEFT:
+        Tape::move( -1 );
+        break;
+
+    case COW_RIGHT:
+        Tape::move( 1 );
+        break;
+
+    // a run of moves and adds in a region
+    case COW_ADDS:
+        {
+            const cow_block& b = blocks[prog_pos - code->begin()];
+            cow_add( &Tape::cell() + b.lo * Tape::pitch(), &b.add[0], b.add.size(), Tape::pitch() );
+            Tape::move( b.move );
+            prog_pos += b.len - 1;
+        }
+        break;
+
+    // bad stuff, unless the memory model knows it
     default:
-        quit( false );
+        if( !Tape::command( instruction ) )
+            quit( false );
     };
 
     prog_pos++;
@@ -198,19 +879,666 @@ bool exec( int instruction )
 }
 
 
+#ifdef __x86_64__
+// -jit: a DDX program with no more stomachs than STOMACH_LANES is turned
+// into x86-64 code with AVX2.  The code is laid out twice.  In the first
+// copy the stomachs are in lockstep and their cells are kept in ymm0, with
+// the row they come from in r12 and the end of memory in r13; the second
+// copy calls back into the interpreter for everything but the jumps.
+// ymm0 is written back before any call, and after it the code goes on in
+// whichever copy fits.  What the code can't do (a mOO that runs a jump, a
+// jump that goes nowhere, Oom off the tape) it leaves to the interpreter,
+// by returning where it stopped.
+bool use_jit = false;
+
+std::vector<unsigned char> jit_code;
+std::vector<int> jit_labels;	// where each label is in jit_code, or -1.
+struct jit_fixup
+{
+    int at;		// the rel32 to fill in.
+    int label;
+};
+std::vector<jit_fixup> jit_fixups;
+
+// what the code reads besides the interpreter's globals: the row and the
+// end of memory, 1 in every stomach's lane, and all ones in lane i alone.
+int* jit_row;
+int* jit_end;
+int jit_ones[STOMACH_LANES];
+int jit_lane[STOMACH_LANES][STOMACH_LANES];
+
+void jit_emit( const char* bytes, int n )
+{
+    jit_code.insert( jit_code.end(), bytes, bytes + n );
+}
+
+#define JIT( bytes ) jit_emit( bytes, sizeof(bytes) - 1 )
+
+void jit_imm( long value, int n )
+{
+    for( int i = 0; i < n; i++ )
+        jit_code.push_back( (unsigned char)(value >> (8 * i)) );
+}
+
+int jit_label()
+{
+    jit_labels.push_back( -1 );
+    return jit_labels.size() - 1;
+}
+
+void jit_place( int label )
+{
+    jit_labels[label] = jit_code.size();
+}
+
+// op is jmp, or a jcc with a rel32.
+void jit_jump( const char* op, int label )
+{
+    jit_emit( op, strlen( op ) );
+    jit_fixup f = { (int)jit_code.size(), label };
+    jit_fixups.push_back( f );
+    jit_imm( 0, 4 );
+}
+
+#define JMP	"\xe9"
+#define JE	"\x0f\x84"
+#define JNE	"\x0f\x85"
+#define JB	"\x0f\x82"
+
+// movabs rax, p
+void jit_addr( const void* p )
+{
+    JIT( "\x48\xb8" );
+    jit_imm( (long)p, 8 );
+}
+
+// call f with edi = arg, when nothing is in ymm0.
+void jit_call( const void* f, int arg )
+{
+    JIT( "\xc5\xf8\x77" );			// vzeroupper
+    JIT( "\xbf" );				// mov edi, arg
+    jit_imm( arg, 4 );
+    jit_addr( f );
+    JIT( "\xff\xd0" );				// call rax
+}
+
+void jit_reload()
+{
+    jit_addr( &jit_row );
+    JIT( "\x4c\x8b\x20" );			// mov r12, [rax]
+    jit_addr( &jit_end );
+    JIT( "\x4c\x8b\x28" );			// mov r13, [rax]
+}
+
+// vmovdqu [r12], ymm0
+void jit_spill()
+{
+    JIT( "\xc4\xc1\x7e\x7f\x04\x24" );
+}
+
+// vmovdqu ymm0, [r12]
+void jit_fill()
+{
+    JIT( "\xc4\xc1\x7e\x6f\x04\x24" );
+}
+
+// after a call: go on at fast in the first copy if the stomachs are in
+// lockstep, else at slow in the second.
+void jit_resume( int fast, int slow )
+{
+    jit_reload();
+    jit_addr( &lockstep );
+    JIT( "\x80\x38\x00" );			// cmp byte [rax], 0
+    jit_jump( JE, slow );
+    jit_fill();
+    jit_jump( JMP, fast );
+}
+
+// rax + rcx is the current stomach's lane in jit_lane.
+void jit_lane_at()
+{
+    jit_addr( &stomach );
+    JIT( "\x8b\x08" );				// mov ecx, [rax]
+    JIT( "\xc1\xe1\x05" );			// shl ecx, 5
+    jit_addr( jit_lane );
+}
+
+// MMm and MmM, the same in both copies.
+void jit_switch( int instruction )
+{
+    jit_addr( &stomach );
+    JIT( "\x8b\x08" );				// mov ecx, [rax]
+    if( instruction == 12 )
+    {
+        JIT( "\xff\xc9" );			// dec ecx
+        JIT( "\xba" );				// mov edx, num_stomachs - 1
+        jit_imm( num_stomachs - 1, 4 );
+        JIT( "\x0f\x48\xca" );			// cmovs ecx, edx
+    }
+    else
+    {
+        JIT( "\xff\xc1" );			// inc ecx
+        JIT( "\x31\xd2" );			// xor edx, edx
+        JIT( "\x81\xf9" );			// cmp ecx, num_stomachs
+        jit_imm( num_stomachs, 4 );
+        JIT( "\x0f\x44\xca" );			// cmove ecx, edx
+    }
+    JIT( "\x89\x08" );				// mov [rax], ecx
+}
+
+// mmm on the row in ymm0, as share_all() and sum_all() do it.
+void jit_mmm()
+{
+    int share = jit_label(), divide = jit_label(), done = jit_label();
+    jit_addr( &has_register_val );
+    JIT( "\x80\x38\x00" );			// cmp byte [rax], 0
+    jit_jump( JNE, share );
+
+    JIT( "\xc6\x00\x01" );			// mov byte [rax], 1
+    JIT( "\xc4\xe3\x7d\x39\xc1\x01" );		// vextracti128 xmm1, ymm0, 1
+    JIT( "\xc5\xf1\xfe\xc8" );			// vpaddd xmm1, xmm1, xmm0
+    JIT( "\xc5\xf9\x70\xd1\x4e" );		// vpshufd xmm2, xmm1, 0x4e
+    JIT( "\xc5\xf1\xfe\xca" );			// vpaddd xmm1, xmm1, xmm2
+    JIT( "\xc5\xf9\x70\xd1\xb1" );		// vpshufd xmm2, xmm1, 0xb1
+    JIT( "\xc5\xf1\xfe\xca" );			// vpaddd xmm1, xmm1, xmm2
+    JIT( "\xc5\xf9\x7e\xc9" );			// vmovd ecx, xmm1
+    jit_addr( &register_val );
+    JIT( "\x89\x08" );				// mov [rax], ecx
+    jit_jump( JMP, done );
+
+    // ymm1 the cells above 0, ecx their sum, eax the register.
+    jit_place( share );
+    JIT( "\xc6\x00\x00" );			// mov byte [rax], 0
+    JIT( "\xc5\xe5\xef\xdb" );			// vpxor ymm3, ymm3, ymm3
+    JIT( "\xc4\xe2\x7d\x3d\xcb" );		// vpmaxsd ymm1, ymm0, ymm3
+    JIT( "\xc4\xe3\x7d\x39\xca\x01" );		// vextracti128 xmm2, ymm1, 1
+    JIT( "\xc5\xe9\xfe\xd1" );			// vpaddd xmm2, xmm2, xmm1
+    JIT( "\xc5\xf9\x70\xe2\x4e" );		// vpshufd xmm4, xmm2, 0x4e
+    JIT( "\xc5\xe9\xfe\xd4" );			// vpaddd xmm2, xmm2, xmm4
+    JIT( "\xc5\xf9\x70\xe2\xb1" );		// vpshufd xmm4, xmm2, 0xb1
+    JIT( "\xc5\xe9\xfe\xd4" );			// vpaddd xmm2, xmm2, xmm4
+    JIT( "\xc5\xf9\x7e\xd1" );			// vmovd ecx, xmm2
+    jit_addr( &register_val );
+    JIT( "\x8b\x00" );				// mov eax, [rax]
+    JIT( "\x85\xc9" );				// test ecx, ecx
+    jit_jump( JNE, divide );
+
+    JIT( "\xc5\xf9\x6e\xc0" );			// vmovd xmm0, eax
+    JIT( "\xc4\xe2\x7d\x58\xc0" );		// vpbroadcastd ymm0, xmm0
+    jit_addr( jit_ones );
+    JIT( "\xc4\xe2\x7d\x40\x00" );		// vpmulld ymm0, ymm0, [rax]
+    jit_jump( JMP, done );
+
+    // the cells above 0 times the quotient, the ones below 0 times minus
+    // the remainder.
+    jit_place( divide );
+    JIT( "\x99" );				// cdq
+    JIT( "\xf7\xf9" );				// idiv ecx
+    JIT( "\xc5\xf9\x6e\xe0" );			// vmovd xmm4, eax
+    JIT( "\xc4\xe2\x7d\x58\xe4" );		// vpbroadcastd ymm4, xmm4
+    JIT( "\xc5\xf9\x6e\xea" );			// vmovd xmm5, edx
+    JIT( "\xc4\xe2\x7d\x58\xed" );		// vpbroadcastd ymm5, xmm5
+    JIT( "\xc5\xe5\x66\xd0" );			// vpcmpgtd ymm2, ymm3, ymm0
+    JIT( "\xc5\xe5\xfa\xf0" );			// vpsubd ymm6, ymm3, ymm0
+    JIT( "\xc5\xed\xdb\xd6" );			// vpand ymm2, ymm2, ymm6
+    JIT( "\xc4\xe2\x75\x40\xcc" );		// vpmulld ymm1, ymm1, ymm4
+    JIT( "\xc4\xe2\x6d\x40\xd5" );		// vpmulld ymm2, ymm2, ymm5
+    JIT( "\xc5\xf5\xfe\xc2" );			// vpaddd ymm0, ymm1, ymm2
+    jit_place( done );
+}
+
+// what the code calls: the end of memory and the row, after memory or
+// the stomachs have changed.
+void jit_sync()
+{
+    jit_row = lockstep ? &memory[row_pos * STOMACH_LANES] : NULL;
+    jit_end = &memory[0] + memory.size();
+}
+
+// run the command at pos in the interpreter, or return 0 if it is a mOO
+// that would jump.
+template<class Tape> int jit_step( int pos )
+{
+    int instruction = program[pos];
+    if( instruction == 3 && (Tape::cell() == 0 || Tape::cell() == 7) )
+        return 0;
+    exec<Tape>( instruction );
+    Tape::settle();
+    jit_sync();
+    return 1;
+}
+
+template<class Tape> int jit_cell()
+{
+    return Tape::cell();
+}
+
+// oOm onto a new row.
+void jit_grow()
+{
+    memory.resize( memory.size() + STOMACH_LANES, 0 );
+    jit_sync();
+}
+
+// the program as code, or NULL if there is no room for it.
+template<class Tape> int (*jit_compile())()
+{
+    int n = program.size();
+    std::vector<int> moo_to, MOO_to;
+    cow_match( program, moo_to, MOO_to );
+
+    for( int i = 0; i < STOMACH_LANES; i++ )
+    {
+        jit_ones[i] = i < num_stomachs;
+        for( int j = 0; j < STOMACH_LANES; j++ )
+            jit_lane[i][j] = i == j ? -1 : 0;
+    }
+
+    // fast[i] and slow[i] are command i in each copy, stop[i] returns i.
+    std::vector<int> fast( n + 1 ), slow( n + 1 ), stop( n + 1 );
+    for( int i = 0; i <= n; i++ )
+    {
+        fast[i] = jit_label();
+        slow[i] = jit_label();
+        stop[i] = jit_label();
+    }
+    int leave = jit_label();
+
+    // rbx only keeps the stack aligned for the calls.
+    JIT( "\x53\x41\x54\x41\x55" );		// push rbx, r12, r13
+    jit_reload();
+    jit_addr( &lockstep );
+    JIT( "\x80\x38\x00" );			// cmp byte [rax], 0
+    jit_jump( JE, slow[0] );
+    jit_fill();
+
+    for( int i = 0; i < n; i++ )
+    {
+        jit_place( fast[i] );
+        switch( program[i] )
+        {
+        // moo
+        case 0:
+            if( moo_to[i] >= 0 )
+                jit_jump( JMP, fast[moo_to[i]] );
+            else
+            {
+                jit_spill();
+                jit_jump( JMP, stop[i] );
+            }
+            break;
+
+        // MOO: vptest is zero for a zero cell.
+        case 7:
+            jit_lane_at();
+            JIT( "\xc4\xe2\x7d\x17\x04\x08" );	// vptest ymm0, [rax+rcx]
+            if( MOO_to[i] >= 0 )
+                jit_jump( JE, fast[std::min( MOO_to[i] + 1, n )] );
+            else
+            {
+                int on = jit_label();
+                jit_jump( JNE, on );
+                jit_spill();
+                jit_jump( JMP, stop[i] );
+                jit_place( on );
+            }
+            break;
+
+        // MOo, MoO and OOO on the current stomach's lane.
+        case 5:
+            jit_lane_at();
+            JIT( "\xc5\xfd\xfe\x04\x08" );	// vpaddd ymm0, ymm0, [rax+rcx]
+            break;
+
+        case 6:
+            jit_lane_at();
+            JIT( "\xc5\xfd\xfa\x04\x08" );	// vpsubd ymm0, ymm0, [rax+rcx]
+            break;
+
+        case 8:
+            jit_lane_at();
+            JIT( "\xc5\xfe\x6f\x0c\x08" );	// vmovdqu ymm1, [rax+rcx]
+            JIT( "\xc5\xf5\xdf\xc0" );		// vpandn ymm0, ymm1, ymm0
+            break;
+
+        case 12:
+        case 13:
+            jit_switch( program[i] );
+            break;
+
+        // Oom: off the tape is the interpreter's to report.
+        case 14:
+            jit_spill();
+            jit_addr( &row_pos );
+            JIT( "\x8b\x08" );			// mov ecx, [rax]
+            JIT( "\x85\xc9" );			// test ecx, ecx
+            jit_jump( JE, stop[i] );
+            JIT( "\xff\xc9" );			// dec ecx
+            JIT( "\x89\x08" );			// mov [rax], ecx
+            JIT( "\x49\x83\xec\x20" );		// sub r12, 32
+            jit_fill();
+            break;
+
+        // oOm, making a new row at the end of memory.
+        case 15:
+            {
+                int there = jit_label();
+                jit_spill();
+                jit_addr( &row_pos );
+                JIT( "\xff\x00" );		// inc dword [rax]
+                JIT( "\x49\x83\xc4\x20" );	// add r12, 32
+                JIT( "\x4d\x39\xec" );		// cmp r12, r13
+                jit_jump( JB, there );
+                jit_call( (void*)jit_grow, 0 );
+                jit_reload();
+                jit_place( there );
+                jit_fill();
+                break;
+            }
+
+        // OoM, oOM and ooo.
+        case 16:
+            jit_addr( jit_ones );
+            JIT( "\xc5\xfd\xfa\x00" );		// vpsubd ymm0, ymm0, [rax]
+            break;
+
+        case 17:
+            jit_addr( jit_ones );
+            JIT( "\xc5\xfd\xfe\x00" );		// vpaddd ymm0, ymm0, [rax]
+            break;
+
+        case 18:
+            JIT( "\xc5\xfd\xef\xc0" );		// vpxor ymm0, ymm0, ymm0
+            break;
+
+        case 19:
+            jit_mmm();
+            break;
+
+        // the rest in the interpreter, with the row written back.
+        default:
+            jit_spill();
+            jit_call( (void*)jit_step<Tape>, i );
+            if( program[i] == 3 )
+            {
+                JIT( "\x85\xc0" );		// test eax, eax
+                jit_jump( JE, stop[i] );
+            }
+            jit_resume( fast[i + 1], slow[i + 1] );
+            break;
+        }
+    }
+    jit_place( fast[n] );
+    jit_spill();
+    jit_jump( JMP, stop[n] );
+
+    for( int i = 0; i < n; i++ )
+    {
+        jit_place( slow[i] );
+        switch( program[i] )
+        {
+        case 0:
+            jit_jump( JMP, moo_to[i] >= 0 ? slow[moo_to[i]] : stop[i] );
+            break;
+
+        case 7:
+            jit_call( (void*)jit_cell<Tape>, 0 );
+            JIT( "\x85\xc0" );			// test eax, eax
+            jit_jump( JE, MOO_to[i] >= 0 ? slow[std::min( MOO_to[i] + 1, n )] : stop[i] );
+            break;
+
+        case 12:
+        case 13:
+            jit_switch( program[i] );
+            break;
+
+        // mOo, moO and mOO can bring the stomachs back into lockstep.
+        default:
+            jit_call( (void*)jit_step<Tape>, i );
+            if( program[i] == 3 )
+            {
+                JIT( "\x85\xc0" );		// test eax, eax
+                jit_jump( JE, stop[i] );
+            }
+            if( program[i] >= 1 && program[i] <= 3 )
+                jit_resume( fast[i + 1], slow[i + 1] );
+            break;
+        }
+    }
+    jit_place( slow[n] );
+    jit_jump( JMP, stop[n] );
+
+    for( int i = 0; i <= n; i++ )
+    {
+        jit_place( stop[i] );
+        JIT( "\xb8" );				// mov eax, i
+        jit_imm( i, 4 );
+        jit_jump( JMP, leave );
+    }
+    jit_place( leave );
+    JIT( "\xc5\xf8\x77" );			// vzeroupper
+    JIT( "\x41\x5d\x41\x5c\x5b\xc3" );		// pop r13, r12, rbx; ret
+
+    for( size_t i = 0; i < jit_fixups.size(); i++ )
+    {
+        int at = jit_fixups[i].at;
+        int rel = jit_labels[jit_fixups[i].label] - (at + 4);
+        memcpy( &jit_code[at], &rel, 4 );
+    }
+
+    void* code = mmap( NULL, jit_code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( code == MAP_FAILED )
+        return NULL;
+    memcpy( code, &jit_code[0], jit_code.size() );
+    if( mprotect( code, jit_code.size(), PROT_READ | PROT_EXEC ) != 0 )
+        return NULL;
+    return (int (*)())code;
+}
+#endif
+
+// run the program as machine code with -jit, as far as that goes.
+template<int N> int ddx_tape<N>::jit()
+{
+#ifdef __x86_64__
+    if( use_jit && width<N>() == STOMACH_LANES && __builtin_cpu_supports( "avx2" ) )
+    {
+        int (*code)() = jit_compile< ddx_tape<N> >();
+        if( code != NULL )
+        {
+            jit_sync();
+            return code();
+        }
+    }
+#endif
+    return 0;
+}
+
+// -profile: the DDX interpreter counting what the program does, with a
+// report on stderr when it ends.  Every command through exec() counts, so
+// a moo counts its MOO again and a mOO the command it runs, or an invalid
+// one in the last count.
+long profile_counts[21];
+long profile_spread;			// commands run out of lockstep.
+std::vector<int> profile_high;		// the furthest row of each stomach,
+int profile_lockstep_high;		// and of all of them in lockstep.
+long profile_mmms;
+double profile_mmm;			// seconds in mmm.
+double profile_start;
+
+// the stomachs listed one by one in the report, at most.
+#define PROFILE_STOMACHS 64
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void profile_report()
+{
+    static const char* names[20] =
+    {
+        "moo", "mOo", "moO", "mOO", "Moo", "MOo", "MoO", "MOO", "OOO", "MMM",
+        "OOM", "oom", "MMm", "MmM", "Oom", "oOm", "OoM", "oOM", "ooo", "mmm"
+    };
+
+    double time = now() - profile_start;
+    long total = 0;
+    for( int i = 0; i < 21; i++ )
+        total += profile_counts[i];
+    double all = total > 0 ? total : 1;
+
+    fprintf( stderr, "\nProfile: %ld commands in %.3fs, %ld (%.1f%%) out of lockstep.\n",
+             total, time, profile_spread, 100 * profile_spread / all );
+    for( int i = 0; i < 20; i++ )
+        fprintf( stderr, "  %2d %s %12ld  %5.1f%%\n", i, names[i], profile_counts[i], 100 * profile_counts[i] / all );
+    if( profile_counts[20] > 0 )
+        fprintf( stderr, "     ??? %12ld  %5.1f%%\n", profile_counts[20], 100 * profile_counts[20] / all );
+
+    long switches = profile_counts[12] + profile_counts[13];
+    if( switches > 0 )
+        fprintf( stderr, "Stomach switches: %ld, one every %.1f commands.\n", switches, total / (double)switches );
+    else
+        fprintf( stderr, "Stomach switches: none.\n" );
+    fprintf( stderr, "mmm: %ld in %.3fs, %.1f%% of the run.\n",
+             profile_mmms, profile_mmm, time > 0 ? 100 * profile_mmm / time : 0.0 );
+
+    // rows are cells of each stomach's tape.
+    int most = 0, least = 0;
+    for( int i = 0; i < num_stomachs; i++ )
+    {
+        int cells = std::max( profile_high[i], profile_lockstep_high ) + 1;
+        if( i == 0 || cells > most )
+            most = cells;
+        if( i == 0 || cells < least )
+            least = cells;
+        if( num_stomachs <= PROFILE_STOMACHS )
+            fprintf( stderr, "  stomach %2d: %d cells\n", i, cells );
+    }
+    fprintf( stderr, "Tape cells used per stomach: %d to %d.\n", least, most );
+}
+
+// a program stopped with ^C still gets its report: count() and
+// read_char() see this and exit, since the handler itself can't safely.
+void profile_stop( int )
+{
+    profile_stopped = 1;
+}
+
+template<int N> struct ddx_profile : public ddx_tape<N>
+{
+    static void count( int instruction )
+    {
+        if( profile_stopped )
+            exit( 1 );
+        profile_counts[instruction >= 0 && instruction < 20 ? instruction : 20]++;
+        ddx_tape<N>::settle();
+        if( !lockstep )
+            profile_spread++;
+    }
+
+    static void start()
+    {
+        ddx_tape<N>::start();
+        profile_high.assign( stomachs<N>(), 0 );
+        profile_start = now();
+        atexit( profile_report );
+
+        // without SA_RESTART, so ^C stops a read waiting for input too.
+        struct sigaction stop;
+        memset( &stop, 0, sizeof(stop) );
+        stop.sa_handler = profile_stop;
+        sigemptyset( &stop.sa_mask );
+        stop.sa_flags = 0;
+        sigaction( SIGINT, &stop, NULL );
+    }
+
+    static void right()
+    {
+        ddx_tape<N>::right();
+        if( row_of( stomach ) > profile_high[stomach] )
+            profile_high[stomach] = row_of( stomach );
+    }
+
+    static bool command( int instruction )
+    {
+        if( instruction == 19 )
+        {
+            double t = now();
+            ddx_tape<N>::command( instruction );
+            profile_mmm += now() - t;
+            profile_mmms++;
+            return true;
+        }
+
+        bool known = ddx_tape<N>::command( instruction );
+        if( instruction == 15 && lockstep )
+            profile_lockstep_high = std::max( profile_lockstep_high, row_pos );
+        else
+        if( instruction == 15 )
+            for( int i=0; i<stomachs<N>(); ++i )
+                profile_high[i] = std::max( profile_high[i], row_of( i ) );
+        return known;
+    }
+
+    // the commands have to go through exec() to be counted.
+    static int jit()
+    {
+        return 0;
+    }
+};
+
+// run the program on the memory model Tape.
+template<class Tape> void run()
+{
+    Tape::start();
+
+    prog_pos = program.begin() + Tape::jit();
+    while( prog_pos != code->end() )
+        if( !exec<Tape>( *prog_pos ) )
+            break;
+}
+
 int main( int argc, char** argv )
 {
-	if( argc < 2 )
+    const char* source = NULL;
+    for( int i = 1; i < argc; i++ )
+    {
+        if( !strcmp( argv[i], "-ddx" ) )
+            ddx = true;
+        else if( !strcmp( argv[i], "-stomachs" ) && i + 1 < argc )
+        {
+            ddx = true;
+            num_stomachs = atoi( argv[++i] );
+        }
+        else if( !strcmp( argv[i], "-threads" ) && i + 1 < argc )
+            num_threads = atoi( argv[++i] );
+        else if( !strcmp( argv[i], "-profile" ) )
+        {
+            ddx = true;
+            profile = true;
+        }
+#ifdef __x86_64__
+        else if( !strcmp( argv[i], "-jit" ) )
+            use_jit = true;
+#endif
+        else
+            source = argv[i];
+    }
+
+	if( source == NULL || num_stomachs < 1 || num_threads < 1 )
 	{
-		printf( "Usage: %s program.cow\n\n", argv[0] );
+		printf( "Usage: %s [-ddx] [-stomachs n] [-threads n] [-jit] [-profile] program.cow\n\n", argv[0] );
 		exit( 1 );
 	}
+    row_width = (num_stomachs + STOMACH_LANES - 1) / STOMACH_LANES * STOMACH_LANES;
 
-	FILE* f = fopen( argv[1], "rb" );
+	FILE* f = fopen( source, "rb" );
 
 	if( f == NULL )
 	{
-		printf( "Cannot open source file [%s].\n", argv[1] );
+		printf( "Cannot open source file [%s].\n", source );
         exit( 1 );
 	}
 
@@ -247,6 +1575,22 @@ int main( int argc, char** argv )
             program.push_back( 10 );
         else if( found = !strncmp( "oom", buf, 3 ) )
             program.push_back( 11 );
+        else if( ddx && (found = !strncmp( "MMm", buf, 3 )) )
+            program.push_back( 12 );
+        else if( ddx && (found = !strncmp( "MmM", buf, 3 )) )
+            program.push_back( 13 );
+        else if( ddx && (found = !strncmp( "Oom", buf, 3 )) )
+            program.push_back( 14 );
+        else if( ddx && (found = !strncmp( "oOm", buf, 3 )) )
+            program.push_back( 15 );
+        else if( ddx && (found = !strncmp( "OoM", buf, 3 )) )
+            program.push_back( 16 );
+        else if( ddx && (found = !strncmp( "oOM", buf, 3 )) )
+            program.push_back( 17 );
+        else if( ddx && (found = !strncmp( "ooo", buf, 3 )) )
+            program.push_back( 18 );
+        else if( ddx && (found = !strncmp( "mmm", buf, 3 )) )
+            program.push_back( 19 );
             
         if( found )
         {
@@ -263,17 +1607,61 @@ int main( int argc, char** argv )
 	fclose( f );
 
 #ifndef NO_GREETINGS
-	printf( "Welcome to COW!\n\nExecuting [%s]...\n\n", argv[1] );
+	printf( "Welcome to COW!\n\nExecuting [%s]...\n\n", source );
 #endif
 
-    // init main memory.
-    memory.push_back( 0 );
-    mem_pos = memory.begin();
+    // turn mOO into the command it runs where that is always the same, then
+    // find the regions, counted loops and runs of adds, and make the
+    // unchecked copy.  Brackets stay mOO, or the scans would change.  Under
+    // DDX they work on the current stomach's tape, which a region never
+    // switches; -profile goes without them, to count every command.
+    std::vector<int> moo_to, MOO_to, known, other, head, offset;
+    int commands = ddx ? 20 : 12;
+    cow_match( program, moo_to, MOO_to );
+    if( profile )
+        known.assign( program.size(), COW_UNKNOWN );
+    else
+        cow_constants( program, moo_to, MOO_to, commands, known );
+    cow_devirt( program, known, commands, fast );
+    program = fast;
+    if( profile )
+        other.assign( program.size(), -1 );
+    else
+        cow_loops( program, moo_to, MOO_to, other );
+    cow_regions( program, other, regions, head, offset );
+    cow_counted_loops( program, other, counted );
+    cow_blocks( program, head, blocks );
+    cow_scans( program, other, scans );
+    fast = program;
+    for( size_t i = 0; i < fast.size(); i++ )
+        if( blocks[i].len > 0 )
+            fast[i] = COW_ADDS;
+        else
+        if( head[i] >= 0 && fast[i] == 1 )
+            fast[i] = COW_LEFT;
+        else
+        if( head[i] >= 0 && fast[i] == 2 )
+            fast[i] = COW_RIGHT;
 
-    prog_pos = program.begin();
-    while( prog_pos != program.end() )
-        if( !exec( *prog_pos ) )
-            break;
+    // plain COW pays nothing for the stomachs.
+    if( ddx )
+        start_threads();
+
+    if( !ddx )
+        run<cow_tape>();
+    else
+    if( profile )
+        run< ddx_profile<0> >();
+    else
+    switch( num_stomachs )
+    {
+    case 4:  run< ddx_tape<4> >();  break;
+    case 7:  run< ddx_tape<7> >();  break;
+    case 8:  run< ddx_tape<8> >();  break;
+    case 16: run< ddx_tape<16> >(); break;
+    case 64: run< ddx_tape<64> >(); break;
+    default: run< ddx_tape<0> >();  break;
+    }
 
     quit( false );
 
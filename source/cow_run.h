@@ -0,0 +1,55 @@
+//--------------------------------------------
+// COW PROGRAMMING LANGUAGE
+// Host interface for programs built with "cowcomp -shared".
+//
+// License: Public Domain
+//--------------------------------------------
+#ifndef COW_RUN_H
+#define COW_RUN_H
+
+#include <dlfcn.h>
+#include <string.h>
+#include <string>
+
+// cowcomp emits a copy of this struct into the generated code, so the two
+// must be kept the same.
+struct cow_ctx
+{
+    void* user;
+
+    // fill buf with up to len bytes of input.  Returns the count, 0 at the end.
+    int (*read)( void* user, char* buf, int len );
+
+    // take len bytes of output.
+    void (*write)( void* user, const char* buf, int len );
+};
+
+// runs the program from a fresh tape.  Safe to call again once it returns,
+// but not from two threads at once.
+typedef int (*cow_run_t)( cow_ctx* ctx );
+
+#define COW_RUN_SYMBOL	"cow_run"
+
+// load a program built by cowcomp -shared.  Returns NULL on failure; the
+// reason is in dlerror().  The handle is for dlclose().
+inline cow_run_t cow_load( const char* path, void** handle )
+{
+    // without a slash dlopen() would search the library path instead.
+    std::string file( path );
+    if( strchr( path, '/' ) == NULL )
+        file.insert( 0, "./" );
+
+    *handle = dlopen( file.c_str(), RTLD_NOW | RTLD_LOCAL );
+    if( *handle == NULL )
+        return NULL;
+
+    cow_run_t run = (cow_run_t)dlsym( *handle, COW_RUN_SYMBOL );
+    if( run == NULL )
+    {
+        dlclose( *handle );
+        *handle = NULL;
+    }
+    return run;
+}
+
+#endif
@@ -8,79 +8,339 @@
 #include <vector>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
 #include <string>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <limits.h>
+#include "cow_run.h"
+#include "cowopt.h"
 
 #define COMPILER	"g++"
 #define FLAGS		"-O3 -x c++"
 #define NAME_FLAG	"-o "
+#define PGO_GENERATE	"-fprofile-generate"
+#define PGO_USE		"-fprofile-use -fprofile-correction -Wno-missing-profile"
 #define OUTPUT_EXEC "cow.out"
 #define OUTPUT_CPP	"cow.out.cpp"
+#define OUTPUT_SO	"cow.out.so"
+#define SHARED_FLAGS	"-shared -fPIC -fvisibility=hidden"
 
+// -llvm: the IR goes through clang when there is one, else opt and llc.
+#define OUTPUT_LL	"cow.out.ll"
+#define LLVM_CLANG	"clang -O3 -fPIC -c -x ir"
+#define LLVM_OPT	"opt -O3"
+#define LLVM_LLC	"llc -O3 -relocation-model=pic -filetype=obj"
+#define LLVM_VERSION	"{ clang --version || llc --version; } 2>/dev/null"
 
-//#define PRETTY(s)	fprintf( output, "\t\t\t// %s\n", s );
+// bump whenever the generated code changes so stale cache entries miss.
+#define BACKEND_VERSION	"cowcomp-14"
+#define CACHE_ENV	"COWCOMP_CACHE"
+#define CACHE_SIZE	(256 * 1024 * 1024)
+
+// starting size of the code buffer, per COW command.
+#define CODE_PER_COMMAND	48
+
+// in split mode no generated function is much longer than this.
+#define SPLIT_FUNC	2000
+
+// compile time evaluation: commands run by default (-eval), and how much
+// output and tape it may leave to the generated code.
+#define EVAL_BUDGET	10000000
+#define EVAL_OUTPUT	(1 << 20)
+#define EVAL_TAPE	65536
+
+
+//#define PRETTY(s)	emit( "\t\t\t// %s\n", s );
 #define PRETTY(s)	
 
 
 typedef std::vector<int> mem_t;
 mem_t program;
 mem_t::iterator prog_pos;
-FILE* output;
 
-int moocount(0);
-int MOOcount(0);
+// generated source is built up here and written out in one go.
+char* code = NULL;
+size_t code_len = 0;
+size_t code_cap = 0;
+
+// how generated code leaves the program; functions return instead.
+const char* exit_stmt = "goto x;";
+
+// MOO and moo commands emitted as a while loop instead of labels.
+std::vector<bool> structured;
+bool use_goto = false;
+
+// loops whose tape bounds are checked once on entry (see cowopt.h).  The C++
+// backend emits each one twice: without checks for when the tape is known
+// to be big enough, and as usual for when it isn't.
+std::vector<cow_region> regions;
+std::vector<int> region_head;
+std::vector<int> region_offset;
+bool unchecked = false;
+int in_region = -1;     // head of the region being emitted
+bool resume_unchecked = false;
+
+// loops that run in closed form (see cowopt.h), in the unchecked copies.
+std::vector<cow_counted> counted;
+
+// runs of moves and adds done in one go, in the unchecked copies.
+std::vector<cow_block> blocks;
+
+// loops that only move, which look for their zero cell with sc().
+std::vector<int> scans;
+
+// emit LLVM IR for the program, plus a C++ file holding the runtime.
+bool use_llvm = false;
+
+// LLVM loop metadata, one entry per loop: whether its body does I/O.
+std::vector<bool> ir_loops;
+std::vector<int> ir_io;     // I/O commands before each position
+int ir_next = 0;
+
+// pointer types in the IR.  LLVM 15 made them all "ptr" and 17 dropped the
+// typed ones, which older versions need; see llvm_check().
+int llvm_version = 0;
+bool ir_opaque = false;
+const char* ir_i32p = "i32*";
+const char* ir_i32pp = "i32**";
+const char* ir_i64p = "i64*";
+const char* ir_i1p = "i1*";
+const char* ir_i8p = "i8*";
+const char* ir_memcpy = "llvm.memcpy.p0i8.p0i8.i64";
+
+// the Distributed Digestion eXtensions (see ddx/ddx.txt): commands 12 to
+// 19 and DDX_STOMACHS tapes, interleaved DDX_WIDTH ints to a row.
+bool ddx = false;
+#define DDX_STOMACHS	7
+#define DDX_WIDTH	8
+
+// the stomach each command starts in, or -1 where that changes (see
+// cow_stomachs() in cowopt.h).
+std::vector<int> stomach_at;
+
+// build a shared object exposing cow_run() instead of an executable.
+bool shared_lib = false;
+bool run_program = false;
+
+bool source_only = false;
+bool show_time = false;
+
+// state left by evaluate(): the generated code starts at eval_pos with
+// eval_out already written, unless nothing was evaluated.
+long long eval_budget = EVAL_BUDGET;
+bool evaluated = false;
+int eval_pos = 0;
+std::string eval_out;
+mem_t eval_tape;
+int eval_idx = 0;
+bool eval_h = false;
+int eval_r = 0;
+
+const char* cache_dir = NULL;
+long long cache_size = CACHE_SIZE;
+const char* training = NULL;
+int split = 0;
+
+
+void code_reserve( size_t size )
+{
+    if( size <= code_cap )
+        return;
+
+    code_cap = std::max( size, code_cap * 2 );
+    code = (char*)realloc( code, code_cap );
+    if( code == NULL )
+    {
+        printf( "Out of memory.\n" );
+        exit( 1 );
+    }
+}
+
+// append printf style.  Most pieces are fixed strings, which skip the
+// formatting.
+void emit( const char* fmt, ... )
+{
+    if( strchr( fmt, '%' ) == NULL )
+    {
+        size_t n = strlen( fmt );
+        code_reserve( code_len + n + 1 );
+        memcpy( code + code_len, fmt, n );
+        code_len += n;
+        return;
+    }
+
+    for( ;; )
+    {
+        va_list args;
+        va_start( args, fmt );
+        size_t room = code_cap - code_len;
+        int n = vsnprintf( code + code_len, room, fmt, args );
+        va_end( args );
 
+        if( n >= 0 && (size_t)n < room )
+        {
+            code_len += n;
+            return;
+        }
+        code_reserve( code_len + (n < 0 ? 256 : n) + 1 );
+    }
+}
 
-void quit()
+// compile() and compile_llvm() give up with this, and the program fails
+// on its own, not the whole batch.
+bool invalid()
 {
     printf( "Compile error.  Invalid source code.\n" );
-    exit(1);
+    return false;
+}
+
+// where a moo (or a mOO acting as one) at each position jumps back to, and
+// where a MOO skips to, filled in by find_matches().
+std::vector<int> moo_to;
+std::vector<int> MOO_to;
+
+// for each mOO the command it always runs, or COW_UNKNOWN.
+std::vector<int> mOO_known;
+
+void find_matches()
+{
+    cow_match( program, moo_to, MOO_to );
+}
+
+// where a moo at pos jumps back to: the index of its MOO, or -1.  Like
+// the interpreter this skips the command just before pos.
+int match_moo( int pos )
+{
+    return moo_to[pos];
+}
+
+// where a MOO at pos skips to when the cell is zero: the index of the moo
+// to continue after, program.size() if there is nothing left, or -1.
+int match_MOO( int pos )
+{
+    return MOO_to[pos];
+}
+
+// the mOO commands with a known cell, the while loops, and the regions
+// among them whose moves need no checks.  A known mOO doesn't jump unless
+// it is a bracket itself, so loops and regions are found as if it were
+// the command it runs.
+void find_loops()
+{
+    int n = program.size();
+    if( ddx )
+    {
+        mOO_known.assign( n, COW_UNKNOWN );
+        cow_stomachs( program, moo_to, MOO_to, DDX_STOMACHS, stomach_at );
+    }
+    else
+        cow_constants( program, moo_to, MOO_to, 12, mOO_known );
+    std::vector<int> plain;
+    cow_devirt( program, mOO_known, ddx ? 20 : 12, plain );
+
+    std::vector<int> other;
+    if( use_goto )
+        other.assign( n, -1 );
+    else
+        cow_loops( plain, moo_to, MOO_to, other );
+
+    structured.assign( n, false );
+    for( int i = 0; i < n; i++ )
+        structured[i] = other[i] >= 0;
+
+    // the tape analyses know nothing of stomachs, so DDX loops get none.
+    std::vector<int> none( n, -1 );
+    const std::vector<int>& loops = ddx ? none : other;
+    cow_regions( plain, loops, regions, region_head, region_offset );
+    cow_counted_loops( plain, loops, counted );
+    cow_blocks( plain, region_head, blocks );
+    cow_scans( plain, loops, scans );
+}
+
+// whether evaluation resumes between from and to in the copy being emitted,
+// so the commands there have to be emitted one by one.
+bool resumes( int from, int to )
+{
+    return evaluated && eval_pos >= from && eval_pos <= to && unchecked == resume_unchecked;
+}
+
+// whether the loop at pos is emitted in closed form.  Not where the tape
+// bounds aren't known.
+bool closes( int pos )
+{
+    int end = counted[pos].end;
+    return unchecked && end >= 0 && !resumes( pos + 1, end );
+}
+
+// the stomach a DDX helper is to work on at pos: the constant where it is
+// known, so the C++ compiler can fold the indexing, else qs.
+const char* stomach( int pos )
+{
+    static char s[16];
+    if( stomach_at[pos] < 0 )
+        return "qs";
+    snprintf( s, sizeof(s), "%d", stomach_at[pos] );
+    return s;
 }
 
 bool compile( int instruction, bool advance )
 {
+    int pos = prog_pos - program.begin();
+
+    // a wide run of moves and adds as one add per cell at a fixed offset,
+    // which the C++ compiler turns into vector adds.
+    const cow_block& b = blocks[pos];
+    if( advance && unchecked && b.len > 0 && !resumes( pos + 1, pos + b.len - 1 ) )
+    {
+        for( size_t i = 0; i < b.add.size(); i++ )
+            if( b.add[i] != 0 )
+                emit( "p[%d]+=%d;", b.lo + (int)i, b.add[i] );
+        if( b.move != 0 )
+            emit( "p+=%d;", b.move );
+        prog_pos += b.len;
+        return true;
+    }
+
     switch( instruction )
     {
     // moo
     case 0:
         {
-            int level = 1;
-            int num = MOOcount + 1;
-            mem_t::iterator t = prog_pos;
-
-            t--;   // skip past previous command when searching for MOO.
-            if( t != program.begin() )
-            {
-                if((*t) == 7 )
-                    num--;
-
-                while( level > 0 )
-                {
-                    if( t == program.begin() )
-                        break;
-
-                    t--;
-            
-                    if( (*t) == 0 )
-                        level++;
-                    else
-                    if( (*t) == 7 )  // look for MOO
-                    {
-                        level--;
-                        num--;
-                    }
-                }
-            }
-            if( level != 0 && advance )
-                quit();
-            else if( level != 0 )
+            int t = match_moo( pos );
+            if( t < 0 && advance )
+                return invalid();
+            else if( t < 0 )
             {
-                fprintf( output, "rterr();" );
+                emit( "rterr();" );
                 break;
             }
 
-            moocount++;
-            fprintf( output, "goto M%d;", num );
-            fprintf( output, "m%d:", moocount );
+            if( advance && structured[pos] && closes( t ) )
+            {
+                // the matrix power, for when the loop would run long.
+                const cow_counted& c = counted[t];
+                int k = c.cells.size();
+                emit( "}}else{static const int o_[]={" );
+                for( int i = 0; i < k; i++ )
+                    emit( "%d,", c.cells[i] );
+                emit( "};static const unsigned a_[]={" );
+                for( int i = 0; i < (k + 1) * (k + 1); i++ )
+                    emit( "%uu,", c.map[i] );
+                emit( "};mp(&*p,o_,%d,a_,u_);}}", k );
+            }
+            else if( advance && structured[pos] )
+                emit( "}" );
+            else if( advance )
+                emit( "goto M%d;m%d:;", t, pos );  // may end a while block
+            else
+                emit( "goto M%d;", t );
             PRETTY( "moo" );
         }
         break;
@@ -88,138 +348,196 @@ bool compile( int instruction, bool advance )
     
     // mOo
     case 1:
-        fprintf( output, "if(p==m.begin()){rterr();}else{p--;}" );
+        if( ddx )
+            emit( "dl(%s);", stomach( pos ) );
+        else if( unchecked )
+            emit( "p--;" );
+        else
+            emit( "if(p==m.begin()){rterr();}else{p--;}" );
         PRETTY( "mOo" );
         break;
 
     // moO
     case 2:
-        fprintf( output, "p++; if(p==m.end()){m.push_back(0);p=m.end();p--;}" );
+        if( ddx )
+            emit( "dr(%s);", stomach( pos ) );
+        else if( unchecked )
+            emit( "p++;" );
+        else
+            emit( "p++; if(p==m.end()){m.push_back(0);p=m.end();p--;}" );
         PRETTY( "moO" );
         break;
     
     // mOO    
     case 3:
+        if( mOO_known[pos] != COW_UNKNOWN )
+        {
+            int c = mOO_known[pos];
+            if( c >= 0 && c <= 11 && c != 3 )
+                compile( c, false );
+            else
+                emit( "%s", exit_stmt );
+            PRETTY( "mOO" );
+            break;
+        }
+
         // I think it should be possible to build a switch statement here and then
         // use the compile function itself to fill in the possibilities.
 //        printf( "NOT IMPLEMENTED: mOO\n\n" );
 //        quit();
-        fprintf( output, "switch(*p){" );
-        fprintf( output, "case 0:{" ); compile( 0, false ); fprintf( output, "}break;" );
-        fprintf( output, "case 1:{" ); compile( 1, false ); fprintf( output, "}break;" );
-        fprintf( output, "case 2:{" ); compile( 2, false ); fprintf( output, "}break;" );
-        fprintf( output, "case 4:{" ); compile( 4, false ); fprintf( output, "}break;" );
-        fprintf( output, "case 5:{" ); compile( 5, false ); fprintf( output, "}break;" );
-        fprintf( output, "case 6:{" ); compile( 6, false ); fprintf( output, "}break;" );
-        fprintf( output, "case 7:{" ); compile( 7, false ); fprintf( output, "}break;" );
-        fprintf( output, "case 8:{" ); compile( 8, false ); fprintf( output, "}break;" );
-        fprintf( output, "case 9:{" ); compile( 9, false ); fprintf( output, "}break;" );
-        fprintf( output, "case 10:{" ); compile( 10, false ); fprintf( output, "}break;" );
-        fprintf( output, "case 11:{" ); compile( 11, false ); fprintf( output, "}break;" );
-        fprintf( output, "default:{goto x;}};" );
+        emit( "switch(*p){" );
+        emit( "case 0:{" ); compile( 0, false ); emit( "}break;" );
+        emit( "case 1:{" ); compile( 1, false ); emit( "}break;" );
+        emit( "case 2:{" ); compile( 2, false ); emit( "}break;" );
+        emit( "case 4:{" ); compile( 4, false ); emit( "}break;" );
+        emit( "case 5:{" ); compile( 5, false ); emit( "}break;" );
+        emit( "case 6:{" ); compile( 6, false ); emit( "}break;" );
+        emit( "case 7:{" ); compile( 7, false ); emit( "}break;" );
+        emit( "case 8:{" ); compile( 8, false ); emit( "}break;" );
+        emit( "case 9:{" ); compile( 9, false ); emit( "}break;" );
+        emit( "case 10:{" ); compile( 10, false ); emit( "}break;" );
+        emit( "case 11:{" ); compile( 11, false ); emit( "}break;" );
+        for( int c = 12; ddx && c <= 19; c++ )
+        {
+            emit( "case %d:{", c ); compile( c, false ); emit( "}break;" );
+        }
+        emit( "default:{%s}};", exit_stmt );
         PRETTY( "mOO" );
         break;
     
     // Moo
     case 4:
-        fprintf( output, "if((*p)!=0){putchar(*p);}else{(*p)=getchar();while(getchar()!='\\n');}" );
+        emit( "if((*p)!=0){oc(*p);}else{(*p)=ic();il();}" );
         PRETTY( "Moo" );
         break;
     
     // MOo
     case 5:
-        fprintf( output, "(*p)--;" );
+        emit( "(*p)--;" );
         PRETTY( "MOo" );
         break;
     
     // MoO
     case 6:
-        fprintf( output, "(*p)++;" );
+        emit( "(*p)++;" );
         PRETTY( "MoO" );
         break;
 
     // MOO
     case 7:
         {
-            int level = 1;
-            int num = moocount;
-            int prev = 0;
-            mem_t::iterator t = prog_pos;
-            t++;	  // have to skip past next command when looking for next moo.
-
-            if( t != program.end() )
+            int t = match_MOO( pos );
+            if( advance && t < 0 )
+                return invalid();
+            else if( t < 0 )
             {
-                if( (*t) == 0 )
-                    num++;
-
-                while( level > 0 )
+                emit( "rterr();" );
+                break;
+            }
+            
+            if( advance && structured[pos] && closes( pos ) )
+            {
+                const cow_counted& c = counted[pos];
+                int k = c.cells.size();
+                emit( "{unsigned u_=(0u-(unsigned)*p)*%uu;", c.inv );
+                if( c.affine )
                 {
-                    prev = *t;
-                    t++;
-                
-                    if( t == program.end() )
-                        break;
-                
-                    if( (*t) == 7 ) // look for MOO command.
-                        level++;
-                    else
-                    if( (*t) == 0 )	// look for moo command.
-                    {
-                        if( prev == 7 )
-                            level--;
-                
-                        level--;
-                        num++;
-                    }
-                
-                    if( level == 0 )
-                        break;
+                    for( int i = 1; i < k; i++ )
+                        emit( "p[%d]+=%uu*u_;", c.cells[i], c.map[i * (k + 1) + k] );
+                    emit( "*p=0;}" );
+                    prog_pos = program.begin() + c.end;
                 }
+                else
+                    emit( "if(u_<%d){while(*p){", COW_MIN_TRIPS );
             }
-            if( advance && level != 0 )
-                quit();
-            else if( level != 0 )
+            else if( advance && structured[pos] )
             {
-                fprintf( output, "rterr();" );
-                break;
+                if( scans[pos] != 0 )
+                    emit( "if(*p){long a_=p-m.begin();sc(&m[0],m.size(),a_,%d);p=m.begin()+a_;}", scans[pos] );
+                emit( "while(*p){" );
+            }
+            else
+            {
+                if( advance )
+                    emit( "M%d:", pos );
+                if( t < (int)program.size() )
+                    emit( "if(!(*p))goto m%d;", t );
             }
-            
-            MOOcount++;
-            fprintf( output, "M%d:", MOOcount );
-            fprintf( output, "if(!(*p))goto m%d;", num );
             PRETTY( "MOO" );
         }
         break;
     
     // OOO
     case 8:
-        fprintf( output, "(*p)=0;" );
+        emit( "(*p)=0;" );
         PRETTY( "OOO" );
         break;
 
     // MMM
     case 9:
-        fprintf( output, "if(h){(*p)=r;}else{r=(*p);}h=!h;" );
+        emit( "if(h){(*p)=r;}else{r=(*p);}h=!h;" );
         PRETTY( "MMM" );
         break;
 
     // OOM
     case 10:
-        fprintf( output, "printf(\"%%d\\n\",*p);" );
+        emit( "od(*p);" );
         PRETTY( "OOM" );
         break;
     
     // oom
     case 11:
-        fprintf( output, "char b[100];int c=0;" );
-        fprintf( output, "while(c<sizeof(b)-1){b[c]=getchar();c++;b[c]=0;if(b[c-1]=='\\n')break;}" );
-        fprintf( output, "if(c==sizeof(b))while(getchar()!='\\n');(*p)=atoi(b);" );
+        emit( "(*p)=ri();" );
         PRETTY( "oom" );
         break;
 
+    // DDX, all through the d*() runtime helpers.  A switch to a known
+    // stomach is a store.
+    case 12:
+    case 13:
+        if( stomach_at[pos] >= 0 )
+        {
+            int k = stomach_at[pos] + (instruction == 12 ? DDX_STOMACHS - 1 : 1);
+            emit( "qs=%d;dc(%d);", k % DDX_STOMACHS, k % DDX_STOMACHS );
+        }
+        else
+            emit( instruction == 12 ? "dp();" : "dn();" );
+        PRETTY( instruction == 12 ? "MMm" : "MmM" );
+        break;
+
+    case 14:
+        emit( "db(%s);", stomach( pos ) );
+        PRETTY( "Oom" );
+        break;
+
+    case 15:
+        emit( "df(%s);", stomach( pos ) );
+        PRETTY( "oOm" );
+        break;
+
+    case 16:
+        emit( "da(-1);" );
+        PRETTY( "OoM" );
+        break;
+
+    case 17:
+        emit( "da(1);" );
+        PRETTY( "oOM" );
+        break;
+
+    case 18:
+        emit( "dz();" );
+        PRETTY( "ooo" );
+        break;
+
+    case 19:
+        emit( "dm();" );
+        PRETTY( "mmm" );
+        break;
+
     // bad stuff
     default:
-        return false;
+        return invalid();
     };
 
     if( advance )
@@ -229,117 +547,1778 @@ bool compile( int instruction, bool advance )
 }
 
 
-int main( int argc, char** argv )
+// the LLVM IR versions of the commands.  Tape state lives in allocas
+// (%base, %idx, %cap, %h, %r) that mem2reg turns into registers.  Blocks
+// are always left open, so every jump is followed by a new label.
+
+// a new temporary holding the address of the current cell.
+int ir_cell()
 {
-	if( argc < 2 )
-	{
-		printf( "Usage: %s program.cow\n\n", argv[0] );
-		exit( 1 );
-	}
+    int t = ir_next;
+    ir_next += 3;
+    emit( "%%t%d=load %s,%s %%base\n", t, ir_i32p, ir_i32pp );
+    emit( "%%t%d=load i64,%s %%idx\n", t + 1, ir_i64p );
+    emit( "%%t%d=getelementptr inbounds i32,%s %%t%d,i64 %%t%d\n", t + 2, ir_i32p, t, t + 1 );
+    return t + 2;
+}
 
-	FILE* f = fopen( argv[1], "rb" );
+// k cells right.  The tape is zero filled up to %cap, so growing it looks
+// the same as push_back one cell at a time.
+void ir_right( int k )
+{
+    int t = ir_next;
+    ir_next += 10;
+    emit( "%%t%d=load i64,%s %%idx\n", t, ir_i64p );
+    emit( "%%t%d=add i64 %%t%d,%d\n", t + 1, t, k );
+    emit( "store i64 %%t%d,%s %%idx\n", t + 1, ir_i64p );
+    emit( "%%t%d=load i64,%s %%cap\n", t + 2, ir_i64p );
+    emit( "%%t%d=icmp uge i64 %%t%d,%%t%d\n", t + 3, t + 1, t + 2 );
+    emit( "br i1 %%t%d,label %%g%d,label %%b%d,!prof !0\ng%d:\n", t + 3, t, t, t );
+    // double, or more if that's still too small.
+    emit( "%%t%d=shl i64 %%t%d,1\n", t + 4, t + 2 );
+    emit( "%%t%d=add i64 %%t%d,1\n", t + 5, t + 1 );
+    emit( "%%t%d=icmp ugt i64 %%t%d,%%t%d\n", t + 6, t + 4, t + 5 );
+    emit( "%%t%d=select i1 %%t%d,i64 %%t%d,i64 %%t%d\n", t + 7, t + 6, t + 4, t + 5 );
+    emit( "%%t%d=load %s,%s %%base\n", t + 8, ir_i32p, ir_i32pp );
+    emit( "%%t%d=call %s @cow_grow(%s %%t%d,i64 %%t%d,i64 %%t%d)\n", t + 9, ir_i32p, ir_i32p, t + 8, t + 2, t + 7 );
+    emit( "store %s %%t%d,%s %%base\n", ir_i32p, t + 9, ir_i32pp );
+    emit( "store i64 %%t%d,%s %%cap\n", t + 7, ir_i64p );
+    emit( "br label %%b%d\nb%d:\n", t, t );
+}
 
-	if( f == NULL )
-	{
-		printf( "Cannot open source file [%s].\n", argv[1] );
-        exit( 1 );
-	}
+// k cells left.  Each step off the first cell is a runtime error.
+void ir_left( int k )
+{
+    int t = ir_next;
+    ir_next += 5;
+    emit( "%%t%d=load i64,%s %%idx\n", t, ir_i64p );
+    emit( "%%t%d=icmp ult i64 %%t%d,%d\n", t + 1, t, k );
+    emit( "%%t%d=sub i64 %%t%d,%d\n", t + 2, t, k );
+    emit( "%%t%d=select i1 %%t%d,i64 0,i64 %%t%d\n", t + 3, t + 1, t + 2 );
+    emit( "store i64 %%t%d,%s %%idx\n", t + 3, ir_i64p );
+    emit( "br i1 %%t%d,label %%e%d,label %%b%d,!prof !0\ne%d:\n", t + 1, t, t, t );
+    emit( "%%t%d=sub i64 %d,%%t%d\n", t + 4, k, t );
+    emit( "call void @cow_errs(i64 %%t%d)\n", t + 4 );
+    emit( "br label %%b%d\nb%d:\n", t, t );
+}
 
-    char buf[3];
-    memset( buf, 0, 3 );
-    int pos = 0;
+// whether the command at pos can join a run started before it.  Labels
+// only sit in front of MOO and after moo, but the resume point can be
+// anywhere.
+bool joins( int pos )
+{
+    return pos < (int)program.size() && !(evaluated && pos == eval_pos);
+}
 
-    while( !feof(f) )
+// same as compile(), except that runs of MoO/MOo and of moO or mOo become
+// a single add or move.
+bool compile_llvm( int instruction, bool advance )
+{
+    int pos = prog_pos - program.begin();
+    int n = program.size();
+    int len = 1;
+    int c, t;
+
+    switch( instruction )
     {
-        int found = 0;
-        buf[2] = fgetc( f );
+    // moo
+    case 0:
+        {
+            int to = match_moo( pos );
+            if( to < 0 && advance )
+                return invalid();
+            else if( to < 0 )
+            {
+                emit( "call void @cow_errs(i64 1)\n" );
+                break;
+            }
 
-        if( found = !strncmp( "moo", buf, 3 ) )
-            program.push_back( 0 );
-        else if( found = !strncmp( "mOo", buf, 3 ) )
-            program.push_back( 1 );
-        else if( found = !strncmp( "moO", buf, 3 ) )
-            program.push_back( 2 );
-        else if( found = !strncmp( "mOO", buf, 3 ) )
-            program.push_back( 3 );
-        else if( found = !strncmp( "Moo", buf, 3 ) )
-            program.push_back( 4 );
-        else if( found = !strncmp( "MOo", buf, 3 ) )
-            program.push_back( 5 );
-        else if( found = !strncmp( "MoO", buf, 3 ) )
-            program.push_back( 6 );
-        else if( found = !strncmp( "MOO", buf, 3 ) )
-            program.push_back( 7 );
-        else if( found = !strncmp( "OOO", buf, 3 ) )
-            program.push_back( 8 );
-        else if( found = !strncmp( "MMM", buf, 3 ) )
-            program.push_back( 9 );
-        else if( found = !strncmp( "OOM", buf, 3 ) )
-            program.push_back( 10 );
-        else if( found = !strncmp( "oom", buf, 3 ) )
-            program.push_back( 11 );
-            
-        if( found )
+            if( advance && structured[pos] )
+            {
+                emit( "br label %%M%d,!llvm.loop !%d\n", to, (int)ir_loops.size() + 2 );
+                ir_loops.push_back( ir_io[pos] > ir_io[to] );
+            }
+            else
+                emit( "br label %%M%d\n", to );
+
+            if( advance )
+                emit( "m%d:\n", pos );
+            else
+                emit( "b%d:\n", ir_next++ );
+        }
+        break;
+
+    // mOo
+    case 1:
+        while( advance && joins( pos + len ) && program[pos + len] == 1 )
+            len++;
+        ir_left( len );
+        break;
+
+    // moO
+    case 2:
+        while( advance && joins( pos + len ) && program[pos + len] == 2 )
+            len++;
+        ir_right( len );
+        break;
+
+    // mOO
+    case 3:
+        if( mOO_known[pos] != COW_UNKNOWN )
         {
-            memset( buf, 0, 3 );
+            int op = mOO_known[pos];
+            if( op >= 0 && op <= 11 && op != 3 )
+                compile_llvm( op, false );
+            else
+                emit( "br label %%x\nb%d:\n", ir_next++ );
+            break;
         }
-        else
+
         {
-            buf[0] = buf[1];
-            buf[1] = buf[2];
-            buf[2] = 0;
+            static const int ops[] = { 0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 11 };
+            const int count = sizeof(ops) / sizeof(ops[0]);
+
+            c = ir_cell();
+            t = ir_next;
+            ir_next++;
+            emit( "%%t%d=load i32,%s %%t%d\n", t, ir_i32p, c );
+            emit( "switch i32 %%t%d,label %%x[", t );
+            for( int i = 0; i < count; i++ )
+                emit( "i32 %d,label %%s%d_%d ", ops[i], t, ops[i] );
+            emit( "]\n" );
+            for( int i = 0; i < count; i++ )
+            {
+                emit( "s%d_%d:\n", t, ops[i] );
+                compile_llvm( ops[i], false );
+                emit( "br label %%b%d\n", t );
+            }
+            emit( "b%d:\n", t );
         }
-    }
+        break;
 
-	fclose( f );
+    // Moo
+    case 4:
+        c = ir_cell();
+        t = ir_next;
+        ir_next += 3;
+        emit( "%%t%d=load i32,%s %%t%d\n", t, ir_i32p, c );
+        emit( "%%t%d=icmp ne i32 %%t%d,0\n", t + 1, t );
+        emit( "br i1 %%t%d,label %%o%d,label %%i%d\no%d:\n", t + 1, t, t, t );
+        emit( "call void @cow_oc(i32 %%t%d)\n", t );
+        emit( "br label %%b%d\ni%d:\n", t, t );
+        emit( "%%t%d=call i32 @cow_in()\n", t + 2 );
+        emit( "store i32 %%t%d,%s %%t%d\n", t + 2, ir_i32p, c );
+        emit( "br label %%b%d\nb%d:\n", t, t );
+        break;
 
-	printf( "Compiling [%s]...\n", argv[1] );
+    // MOo, MoO
+    case 5:
+    case 6:
+        {
+            int delta = instruction == 6 ? 1 : -1;
+            while( advance && joins( pos + len ) && (program[pos + len] == 5 || program[pos + len] == 6) )
+                delta += program[pos + len++] == 6 ? 1 : -1;
+            if( delta == 0 )
+                break;
 
-    // init main memory.
-    /*
-    memory.push_back( 0 );
-    mem_pos = memory.begin();
-    */
-    
-    output = fopen( "cow.out.cpp", "wb" );
-    fprintf( output, "#include <stdio.h>\n" );
-    fprintf( output, "#include <vector>\n" );
-    fprintf( output, "typedef std::vector<int> t_;t_ m;t_::iterator p;\n" );
-    fprintf( output, "bool h;int r;\n" );
-    fprintf( output, "void rterr(){puts(\"Runtime error.\\n\");}\n" );
-    fprintf( output, "int main(int a,char** v){\n" );
-    fprintf( output, "m.push_back(0);p=m.begin();h=false;\n" );
-
-    prog_pos = program.begin();
-    while( prog_pos != program.end() )
-        if( !compile( *prog_pos, true ) )
+            c = ir_cell();
+            t = ir_next;
+            ir_next += 2;
+            emit( "%%t%d=load i32,%s %%t%d\n", t, ir_i32p, c );
+            emit( "%%t%d=add i32 %%t%d,%d\n", t + 1, t, delta );
+            emit( "store i32 %%t%d,%s %%t%d\n", t + 1, ir_i32p, c );
+        }
+        break;
+
+    // MOO
+    case 7:
         {
-            printf( "ERROR!\n" );
-            break;
+            int to = match_MOO( pos );
+            if( advance && to < 0 )
+                return invalid();
+            else if( to < 0 )
+            {
+                emit( "call void @cow_errs(i64 1)\n" );
+                break;
+            }
+
+            // a scan loop starts where sc() got to.  The tape is zero filled
+            // up to %cap, so it may look that far.
+            if( advance && structured[pos] && scans[pos] != 0 )
+            {
+                t = ir_next;
+                ir_next += 3;
+                emit( "%%t%d=load %s,%s %%base\n", t, ir_i32p, ir_i32pp );
+                emit( "%%t%d=load i64,%s %%idx\n", t + 1, ir_i64p );
+                emit( "%%t%d=load i64,%s %%cap\n", t + 2, ir_i64p );
+                emit( "%%t%d=call i64 @cow_sc(%s %%t%d,i64 %%t%d,i64 %%t%d,i32 %d)\n",
+                      ir_next++, ir_i32p, t, t + 2, t + 1, scans[pos] );
+                emit( "store i64 %%t%d,%s %%idx\n", ir_next - 1, ir_i64p );
+            }
+            if( advance )
+                emit( "br label %%M%d\nM%d:\n", pos, pos );
+            if( to < n )
+            {
+                c = ir_cell();
+                t = ir_next;
+                ir_next += 2;
+                emit( "%%t%d=load i32,%s %%t%d\n", t, ir_i32p, c );
+                emit( "%%t%d=icmp eq i32 %%t%d,0\n", t + 1, t );
+                emit( "br i1 %%t%d,label %%m%d,label %%b%d\nb%d:\n", t + 1, to, t, t );
+            }
         }
-        
-    fprintf( output, "x:return(0);}\n" );        
-    fclose( output );
+        break;
+
+    // OOO
+    case 8:
+        c = ir_cell();
+        emit( "store i32 0,%s %%t%d\n", ir_i32p, c );
+        break;
 
-    printf( "C++ source code: cow.out.cpp\n" );
+    // MMM
+    case 9:
+        c = ir_cell();
+        t = ir_next;
+        ir_next += 5;
+        // storing and loading both leave the cell and the register equal.
+        emit( "%%t%d=load i32,%s %%t%d\n", t, ir_i32p, c );
+        emit( "%%t%d=load i1,%s %%h\n", t + 1, ir_i1p );
+        emit( "%%t%d=load i32,%s %%r\n", t + 2, ir_i32p );
+        emit( "%%t%d=select i1 %%t%d,i32 %%t%d,i32 %%t%d\n", t + 3, t + 1, t + 2, t );
+        emit( "store i32 %%t%d,%s %%t%d\n", t + 3, ir_i32p, c );
+        emit( "store i32 %%t%d,%s %%r\n", t + 3, ir_i32p );
+        emit( "%%t%d=xor i1 %%t%d,true\n", t + 4, t + 1 );
+        emit( "store i1 %%t%d,%s %%h\n", t + 4, ir_i1p );
+        break;
 
-    #ifdef COMPILER
-        std::string path( (const char*)COMPILER );
-        path.append( " " );
-        path.append( (const char*)NAME_FLAG );
-        path.append( " " );
-        path.append( (const char*)OUTPUT_EXEC );
-        path.append( " " );
-        path.append( (const char*)FLAGS );
-        path.append( " " );
-        path.append( (const char*)OUTPUT_CPP );
-        if( system( path.c_str() ) )
-            printf( "\n\nCould not compile.  Possible causes:  C++ compiler is not installed, not in path, or not named '%s' or there is a bug in this compiler.\n\n", COMPILER );
-        else
-            printf( "Executable created: cow.out\n" );
-    #endif
+    // OOM
+    case 10:
+        c = ir_cell();
+        t = ir_next++;
+        emit( "%%t%d=load i32,%s %%t%d\n", t, ir_i32p, c );
+        emit( "call void @cow_od(i32 %%t%d)\n", t );
+        break;
+
+    // oom
+    case 11:
+        c = ir_cell();
+        t = ir_next++;
+        emit( "%%t%d=call i32 @cow_ri()\n", t );
+        emit( "store i32 %%t%d,%s %%t%d\n", t, ir_i32p, c );
+        break;
+
+    // bad stuff
+    default:
+        return invalid();
+    };
+
+    if( advance )
+        prog_pos += len;
+
+    return true;
+}
 
-	return 0;
+
+// FNV-1a.  Only used to name cache entries, so it doesn't need to be strong.
+typedef unsigned long long hash_t;
+
+hash_t hash_bytes( hash_t h, const void* data, size_t len )
+{
+    const unsigned char* d = (const unsigned char*)data;
+    for( size_t i = 0; i < len; i++ )
+    {
+        h ^= d[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
 }
 
+hash_t hash_str( hash_t h, const char* s )
+{
+    // include the terminator so "ab"+"c" and "a"+"bc" differ.
+    return hash_bytes( h, s, strlen( s ) + 1 );
+}
 
+// copy a file with its permissions, so only executables come out
+// executable.
+bool copy_file( const char* from, const char* to )
+{
+    struct stat st;
+    if( stat( from, &st ) != 0 )
+        return false;
+
+    FILE* in = fopen( from, "rb" );
+    if( in == NULL )
+        return false;
+
+    FILE* out = fopen( to, "wb" );
+    if( out == NULL )
+    {
+        fclose( in );
+        return false;
+    }
+
+    char buf[65536];
+    size_t n;
+    bool ok = true;
+    while( (n = fread( buf, 1, sizeof(buf), in )) > 0 )
+        if( fwrite( buf, 1, n, out ) != n )
+        {
+            ok = false;
+            break;
+        }
+
+    fclose( in );
+    if( fclose( out ) != 0 )
+        ok = false;
+    chmod( to, st.st_mode & 0777 );
+    return ok;
+}
+
+hash_t hash_file( hash_t h, const char* path )
+{
+    FILE* f = fopen( path, "rb" );
+    if( f == NULL )
+        return h;
+
+    char buf[65536];
+    size_t n;
+    while( (n = fread( buf, 1, sizeof(buf), f )) > 0 )
+        h = hash_bytes( h, buf, n );
+    fclose( f );
+    return h;
+}
+
+// rename, or copy when source and destination are on different filesystems.
+bool move_file( const char* from, const char* to )
+{
+    if( rename( from, to ) == 0 )
+        return true;
+    if( !copy_file( from, to ) )
+        return false;
+    unlink( from );
+    return true;
+}
+
+// the key covers everything that can change the executable: the parsed
+// program, the C++ compiler command line and the code generator itself.
+std::string cache_key()
+{
+    hash_t h = 14695981039346656037ULL;
+    h = hash_str( h, BACKEND_VERSION );
+    h = hash_str( h, COMPILER );
+    h = hash_str( h, FLAGS );
+    if( training != NULL )
+        h = hash_file( hash_str( h, PGO_USE ), training );
+    if( split )
+        h = hash_bytes( hash_str( h, "split" ), &split, sizeof(split) );
+    if( use_goto )
+        h = hash_str( h, "goto" );
+    if( ddx )
+        h = hash_str( h, "ddx" );
+    if( use_llvm )
+    {
+        h = hash_str( hash_str( hash_str( h, LLVM_CLANG ), LLVM_OPT ), LLVM_LLC );
+        h = hash_bytes( h, &llvm_version, sizeof(llvm_version) );
+    }
+    if( !split )
+        h = hash_bytes( hash_str( h, "eval" ), &eval_budget, sizeof(eval_budget) );
+    if( shared_lib )
+        h = hash_str( h, SHARED_FLAGS );
+    if( !program.empty() )
+        h = hash_bytes( h, &program[0], program.size() * sizeof(int) );
+
+    char name[32];
+    snprintf( name, sizeof(name), "%016llx", h );
+    return name;
+}
+
+std::string cache_path( const std::string& key, const char* ext )
+{
+    std::string path( cache_dir );
+    path.append( "/" );
+    path.append( key );
+    path.append( ext );
+    return path;
+}
+
+bool cache_fetch( const std::string& key, const char* ext, const char* dest )
+{
+    std::string path = cache_path( key, ext );
+    if( access( path.c_str(), R_OK ) != 0 )
+        return false;
+
+    // mtime is the LRU clock.
+    utime( path.c_str(), NULL );
+
+    // dest may be running or the copy may fail, so the old one stays
+    // until the new one is whole.
+    char tmp[32];
+    snprintf( tmp, sizeof(tmp), ".tmp.%d", (int)getpid() );
+    std::string part = std::string( dest ) + tmp;
+    if( copy_file( path.c_str(), part.c_str() ) && rename( part.c_str(), dest ) == 0 )
+        return true;
+    unlink( part.c_str() );
+    return false;
+}
+
+struct cache_entry
+{
+    std::string path;
+    time_t used;
+    long long size;
+
+    bool operator<( const cache_entry& o ) const { return used < o.used; }
+};
+
+// drop least recently used entries until the directory fits in cache_size.
+void cache_evict()
+{
+    DIR* d = opendir( cache_dir );
+    if( d == NULL )
+        return;
+
+    std::vector<cache_entry> entries;
+    long long total = 0;
+    struct dirent* e;
+    while( (e = readdir( d )) != NULL )
+    {
+        if( e->d_name[0] == '.' )
+            continue;
+
+        cache_entry c;
+        c.path = cache_dir;
+        c.path.append( "/" );
+        c.path.append( e->d_name );
+
+        struct stat st;
+        if( stat( c.path.c_str(), &st ) != 0 || !S_ISREG( st.st_mode ) )
+            continue;
+
+        c.used = st.st_mtime;
+        c.size = st.st_size;
+        total += c.size;
+        entries.push_back( c );
+    }
+    closedir( d );
+
+    std::sort( entries.begin(), entries.end() );
+    for( size_t i = 0; i < entries.size() && total > cache_size; i++ )
+    {
+        if( unlink( entries[i].path.c_str() ) == 0 )
+            total -= entries[i].size;
+    }
+}
+
+void cache_store( const std::string& key, const char* ext, const char* file )
+{
+    // copy under a private name and rename so readers never see half a file.
+    // The name starts with a dot, so cache_evict() leaves it alone.
+    std::string path = cache_path( key, ext );
+    char tmp[32];
+    snprintf( tmp, sizeof(tmp), ".tmp.%d", (int)getpid() );
+    std::string part = cache_path( "." + key, ext ) + tmp;
+
+    mkdir( cache_dir, 0755 );
+    if( copy_file( file, part.c_str() ) && rename( part.c_str(), path.c_str() ) == 0 )
+        cache_evict();
+    else
+        unlink( part.c_str() );
+}
+
+
+// wrap a path in single quotes for the shell.
+std::string quote( const std::string& s )
+{
+    std::string q( "'" );
+    for( size_t i = 0; i < s.size(); i++ )
+        if( s[i] == '\'' )
+            q.append( "'\\''" );
+        else
+            q.push_back( s[i] );
+    q.append( "'" );
+    return q;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+bool parse( const char* source )
+{
+	FILE* f = fopen( source, "rb" );
+
+	if( f == NULL )
+	{
+		printf( "Cannot open source file [%s].\n", source );
+        return false;
+	}
+
+    program.clear();
+
+    char buf[3];
+    memset( buf, 0, 3 );
+
+    while( !feof(f) )
+    {
+        int found = 0;
+        buf[2] = fgetc( f );
+
+        if( found = !strncmp( "moo", buf, 3 ) )
+            program.push_back( 0 );
+        else if( found = !strncmp( "mOo", buf, 3 ) )
+            program.push_back( 1 );
+        else if( found = !strncmp( "moO", buf, 3 ) )
+            program.push_back( 2 );
+        else if( found = !strncmp( "mOO", buf, 3 ) )
+            program.push_back( 3 );
+        else if( found = !strncmp( "Moo", buf, 3 ) )
+            program.push_back( 4 );
+        else if( found = !strncmp( "MOo", buf, 3 ) )
+            program.push_back( 5 );
+        else if( found = !strncmp( "MoO", buf, 3 ) )
+            program.push_back( 6 );
+        else if( found = !strncmp( "MOO", buf, 3 ) )
+            program.push_back( 7 );
+        else if( found = !strncmp( "OOO", buf, 3 ) )
+            program.push_back( 8 );
+        else if( found = !strncmp( "MMM", buf, 3 ) )
+            program.push_back( 9 );
+        else if( found = !strncmp( "OOM", buf, 3 ) )
+            program.push_back( 10 );
+        else if( found = !strncmp( "oom", buf, 3 ) )
+            program.push_back( 11 );
+        // from here down, DDX only.
+        else if( ddx && (found = !strncmp( "MMm", buf, 3 )) )
+            program.push_back( 12 );
+        else if( ddx && (found = !strncmp( "MmM", buf, 3 )) )
+            program.push_back( 13 );
+        else if( ddx && (found = !strncmp( "Oom", buf, 3 )) )
+            program.push_back( 14 );
+        else if( ddx && (found = !strncmp( "oOm", buf, 3 )) )
+            program.push_back( 15 );
+        else if( ddx && (found = !strncmp( "OoM", buf, 3 )) )
+            program.push_back( 16 );
+        else if( ddx && (found = !strncmp( "oOM", buf, 3 )) )
+            program.push_back( 17 );
+        else if( ddx && (found = !strncmp( "ooo", buf, 3 )) )
+            program.push_back( 18 );
+        else if( ddx && (found = !strncmp( "mmm", buf, 3 )) )
+            program.push_back( 19 );
+            
+        if( found )
+        {
+            memset( buf, 0, 3 );
+        }
+        else
+        {
+            buf[0] = buf[1];
+            buf[1] = buf[2];
+            buf[2] = 0;
+        }
+    }
+
+	fclose( f );
+    return true;
+}
+
+// a cut before pos is possible when no goto crosses it.  In well formed
+// programs that is exactly between top level loops.
+std::vector<bool> find_cuts()
+{
+    int n = program.size();
+    std::vector<int> crossing( n + 2, 0 );
+    for( int i = 0; i < n; i++ )
+    {
+        int targets[2] = { -1, -1 };
+        if( program[i] == 0 || program[i] == 3 )
+            targets[0] = match_moo( i );
+        if( program[i] == 7 || program[i] == 3 )
+            targets[1] = match_MOO( i );
+
+        for( int k = 0; k < 2; k++ )
+        {
+            int t = targets[k];
+            if( t < 0 || t >= n || t == i )
+                continue;
+            crossing[std::min( i, t ) + 1]++;
+            crossing[std::max( i, t ) + 1]--;
+        }
+    }
+
+    std::vector<bool> cuts( n + 1, false );
+    int open = 0;
+    for( int c = 0; c <= n; c++ )
+    {
+        open += crossing[c];
+        cuts[c] = open == 0;
+    }
+    return cuts;
+}
+
+// the DDX runtime.  Stomach i is at row qb+q[i] of m, its cell there is
+// m[(qb+q[i])*DDX_WIDTH+i], and p stays on the current stomach's cell, so
+// the COW commands are emitted as usual.  ql and qh are the least and
+// greatest q[i].  In lockstep (qk) every q[i] is 0: the stomachs move
+// together by changing qb alone, and the commands on all stomachs take
+// the row as one vector.  The lanes past the last stomach stay 0.
+void ddx_prelude()
+{
+    int s = DDX_STOMACHS, w = DDX_WIDTH;
+    emit( "typedef int dv_ __attribute__((vector_size(%d)));\n", w * 4 );
+    emit( "static const dv_ d1={" );
+    for( int i = 0; i < w; i++ )
+        emit( i < s ? "1," : "0," );
+    emit( "};\n" );
+    // stomach s's cell, cell i, and room up to the highest row.
+    emit( "static inline void dc(int s){p=m.begin()+(qb+q[s])*%d+s;}\n", w );
+    emit( "static inline int& de(int i){return m[(qb+q[i])*%d+i];}\n", w );
+    emit( "static inline void dg(){long n=(qb+qh+1)*%d;if(n>(long)m.size())m.resize(n);}\n", w );
+    // after one stomach moves: the spread again, and back to lockstep.
+    emit( "static void ds(){ql=qh=q[0];for(int i=1;i<%d;i++){if(q[i]<ql)ql=q[i];if(q[i]>qh)qh=q[i];}", s );
+    emit( "qk=ql==qh;if(qk){qb+=ql;for(int i=0;i<%d;i++)q[i]=0;ql=qh=0;}}\n", s );
+    // mOo, moO, MMm, MmM, Oom and oOm.  s is the current stomach, qs or the
+    // same as a constant.
+    emit( "static inline void dl(int s){if(qb+q[s]==0){rterr();return;}q[s]--;ds();dc(s);}\n" );
+    emit( "static inline void dr(int s){q[s]++;ds();dg();dc(s);}\n" );
+    emit( "static inline void dp(){qs=qs?qs-1:%d;dc(qs);}\n", s - 1 );
+    emit( "static inline void dn(){qs=qs==%d?0:qs+1;dc(qs);}\n", s - 1 );
+    emit( "static inline void db(int s){if(qb+ql==0){rterr();return;}qb--;dc(s);}\n" );
+    emit( "static inline void df(int s){qb++;dg();dc(s);}\n" );
+    // the row in lockstep; OoM and oOM, ooo.
+    emit( "static inline void dv(dv_& v){memcpy(&v,&m[qb*%d],sizeof(v));}\n", w );
+    emit( "static inline void dw(const dv_& v){memcpy(&m[qb*%d],&v,sizeof(v));}\n", w );
+    emit( "static inline void da(int d){if(qk){dv_ v;dv(v);v+=d1*d;dw(v);}else for(int i=0;i<%d;i++)de(i)+=d;}\n", s );
+    emit( "static inline void dz(){if(qk){dv_ z={};dw(z);}else for(int i=0;i<%d;i++)de(i)=0;}\n", s );
+    // mmm: the sum into the register, or the register shared out by weight
+    // with one division.
+    emit( "static void dm(){if(!h){unsigned t=0;if(qk){dv_ v;dv(v);for(int i=0;i<%d;i++)t+=v[i];}", w );
+    emit( "else for(int i=0;i<%d;i++)t+=de(i);r=t;h=true;return;}h=false;", s );
+    emit( "if(qk){dv_ v,z={};dv(v);dv_ ps=v>z?v:z,ng=v<z?-v:z;unsigned t=0;for(int i=0;i<%d;i++)t+=ps[i];", w );
+    emit( "if(!t){v=d1*r;dw(v);return;}int b=r/(int)t;v=ps*b+ng*(r-b*(int)t);dw(v);return;}" );
+    emit( "unsigned t=0;for(int i=0;i<%d;i++)if(de(i)>0)t+=de(i);", s );
+    emit( "if(!t){for(int i=0;i<%d;i++)de(i)=r;return;}int b=r/(int)t,o=r-b*(int)t;", s );
+    emit( "for(int i=0;i<%d;i++){int c=de(i);de(i)=c>0?c*b:c<0?-c*o:0;}}\n", s );
+}
+
+// the emitted runtime.  Output is collected in ob and handed over by of()
+// when full, before blocking on input, and at exit.  Input is read in
+// blocks into ib by ir().  ic() reads a char, il() skips the rest of the
+// line, ri() reads a number the way oom does, oc() writes a char, od() a
+// number and newline, os() a string.  Only of() and ir() touch the outside
+// world: stdio descriptors in an executable, the host's callbacks in a
+// shared object.
+void prelude( bool defs )
+{
+    emit( "#include <stdio.h>\n" );
+    emit( "#include <stdlib.h>\n" );
+    emit( "#include <string.h>\n" );
+    emit( "#include <unistd.h>\n" );
+    emit( "#include <vector>\n" );
+    if( defs )
+    {
+        emit( "typedef std::vector<int> t_;t_ m;t_::iterator p;\n" );
+        emit( "bool h;int r;\n" );
+        emit( "char ob[1<<16];int on;char ib[1<<16];int ip,in;\n" );
+        if( ddx )
+            emit( "long qb,q[%d],ql,qh;int qs;bool qk;\n", DDX_STOMACHS );
+    }
+    else
+    {
+        emit( "typedef std::vector<int> t_;extern t_ m;extern t_::iterator p;\n" );
+        emit( "extern bool h;extern int r;\n" );
+        emit( "extern char ob[1<<16];extern int on;extern char ib[1<<16];extern int ip,in;\n" );
+        if( ddx )
+            emit( "extern long qb,q[%d],ql,qh;extern int qs;extern bool qk;\n", DDX_STOMACHS );
+    }
+    emit( "void of();bool ir();void rterr();\n" );
+
+    emit( "static inline int ic(){if(ip==in&&!ir())return EOF;return (unsigned char)ib[ip++];}\n" );
+    emit( "static inline void il(){int c;do c=ic();while(c!='\\n'&&c!=EOF);}\n" );
+    emit( "static inline void oc(int c){if(on==sizeof(ob))of();ob[on++]=c;}\n" );
+    emit( "static inline void os(const char* s){while(*s)oc(*s++);}\n" );
+    emit( "static inline void od(int d){if(on>(int)sizeof(ob)-12)of();" );
+    emit( "unsigned u=d<0?0u-(unsigned)d:(unsigned)d;char t[10];int n=0;" );
+    emit( "do{t[n++]='0'+u%%10;u/=10;}while(u);if(d<0)ob[on++]='-';" );
+    emit( "while(n)ob[on++]=t[--n];ob[on++]='\\n';}\n" );
+    // same result as atoi() on the first line, or its first 99 chars.
+    emit( "static inline int ri(){int c=ic(),k=1;unsigned v=0;bool neg=false;" );
+    emit( "while(c==' '||(c>='\\t'&&c<='\\r'&&c!='\\n')){if(k++==99)return 0;c=ic();}" );
+    emit( "if(c=='-'||c=='+'){neg=c=='-';if(k++==99)return 0;c=ic();}" );
+    emit( "while(c>='0'&&c<='9'){v=v*10+(c-'0');if(k++==99)return neg?0u-v:v;c=ic();}" );
+    emit( "if(c!='\\n'&&c!=EOF&&k<99){while(k++<99&&(c=ic())!='\\n'&&c!=EOF);}" );
+    emit( "return neg?0u-v:v;}\n" );
+    // on entry to a region: whether the tape reaches lo cells left, after
+    // growing it to reach hi cells right.
+    emit( "static inline bool tb(int lo,int hi){long o=p-m.begin();if(o<lo)return false;" );
+    emit( "if(o+hi>=(long)m.size()){m.resize(o+hi+1);p=m.begin()+o;}return true;}\n" );
+    // a loop run t times as a power of its k+1 square matrix a, on the
+    // cells at offsets o from c (see cow_close() in cowopt.h).
+    emit( "static void mp(int* c,const int* o,int k,const unsigned* a,unsigned t){" );
+    emit( "int n=k+1;unsigned v[%d],w[%d],b[%d],s[%d];", COW_CELLS + 1, COW_CELLS + 1,
+          (COW_CELLS + 1) * (COW_CELLS + 1), (COW_CELLS + 1) * (COW_CELLS + 1) );
+    emit( "for(int i=0;i<k;i++)v[i]=c[o[i]];v[k]=1;memcpy(b,a,n*n*4);" );
+    emit( "for(;t;t>>=1){if(t&1){for(int i=0;i<n;i++){unsigned x=0;" );
+    emit( "for(int j=0;j<n;j++)x+=b[i*n+j]*v[j];w[i]=x;}memcpy(v,w,n*4);}" );
+    emit( "for(int i=0;i<n;i++)for(int j=0;j<n;j++){unsigned x=0;" );
+    emit( "for(int l=0;l<n;l++)x+=b[i*n+l]*b[l*n+j];s[i*n+j]=x;}memcpy(b,s,n*n*4);}" );
+    emit( "for(int i=0;i<k;i++)c[o[i]]=v[i];}\n" );
+    // a scan loop's zero cell, or the last cell it reaches in the n there
+    // are, several cells at a time (see cow_scan() in cowopt.h).
+    emit( "#if defined(__AVX2__)\n#include <immintrin.h>\n#define SL 8\n" );
+    emit( "static inline int sz(const int* c){return _mm256_movemask_ps(_mm256_castsi256_ps(" );
+    emit( "_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)c),_mm256_setzero_si256())));}\n" );
+    emit( "#elif defined(__SSE2__)\n#include <immintrin.h>\n#define SL 4\n" );
+    emit( "static inline int sz(const int* c){return _mm_movemask_ps(_mm_castsi128_ps(" );
+    emit( "_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)c),_mm_setzero_si128())));}\n" );
+    emit( "#else\n#define SL 1\nstatic inline int sz(const int* c){return *c==0;}\n#endif\n" );
+    emit( "static inline bool sc(const int* m,long n,long& a,int s){int w=s<0?-s:s;long i=a+s;" );
+    emit( "if(w<=SL){int k=0;for(int l=0;l<SL;l+=w)k|=s>0?1<<l:1<<(SL-1-l);long d=(SL+w-1)/w*w;" );
+    emit( "if(s>0){for(;i+SL<=n;i+=d){int z=sz(m+i)&k;if(z){a=i+__builtin_ctz(z);return true;}}}" );
+    emit( "else{for(;i-SL+1>=0;i-=d){int z=sz(m+i-SL+1)&k;if(z){a=i-SL+1+31-__builtin_clz(z);return true;}}}}" );
+    emit( "for(;i>=0&&i<n;i+=s)if(!m[i]){a=i;return true;}a=i-s;return false;}\n" );
+    if( ddx )
+        ddx_prelude();
+    if( !defs )
+        return;
+
+    if( shared_lib )
+    {
+        // must match cow_ctx in cow_run.h.
+        emit( "struct cow_ctx{void* user;int(*read)(void*,char*,int);void(*write)(void*,const char*,int);};\n" );
+        emit( "cow_ctx* ctx;\n" );
+        emit( "void of(){if(on)ctx->write(ctx->user,ob,on);on=0;}\n" );
+        emit( "bool ir(){of();ip=0;in=ctx->read(ctx->user,ib,sizeof(ib));if(in<0)in=0;return in>0;}\n" );
+    }
+    else
+    {
+        emit( "void of(){for(int d=0,k;d<on;d+=k)if((k=write(1,ob+d,on-d))<=0)break;on=0;}\n" );
+        emit( "bool ir(){of();ip=0;in=read(0,ib,sizeof(ib));if(in<0)in=0;return in>0;}\n" );
+    }
+    emit( "void rterr(){os(\"Runtime error.\\n\\n\");}\n" );
+}
+
+// start of the function that runs the program: main() in an executable,
+// cow_run() in a shared object, which can be called any number of times.
+void entry()
+{
+    if( shared_lib )
+    {
+        emit( "extern \"C\" __attribute__((visibility(\"default\"))) int cow_run(cow_ctx* c){\n" );
+        emit( "ctx=c;m.assign(1,0);p=m.begin();h=false;r=0;on=ip=in=0;\n" );
+    }
+    else
+    {
+        emit( "int main(int a,char** v){\n" );
+        emit( "m.push_back(0);p=m.begin();h=false;\n" );
+    }
+    if( ddx )
+        emit( "m.assign(%d,0);p=m.begin();qb=ql=qh=0;qs=0;qk=true;memset(q,0,sizeof(q));\n", DDX_WIDTH );
+}
+
+// run the program at compile time until it wants input, and hand the
+// generated code the state it stopped in.  Stops early after eval_budget
+// commands, or when the output or tape gets too big to embed.
+void evaluate()
+{
+    int n = program.size();
+    eval_out.clear();
+    eval_tape.assign( 1, 0 );
+    eval_idx = 0;
+    eval_h = false;
+    eval_r = 0;
+    eval_pos = 0;
+    evaluated = false;
+
+    // only COW has a compile time interpreter.
+    if( ddx )
+        return;
+
+    // an invalid program must still fail to compile.
+    for( int i = 0; i < n; i++ )
+        if( (program[i] == 0 && match_moo( i ) < 0) || (program[i] == 7 && match_MOO( i ) < 0) )
+            return;
+
+    long long steps = 0;
+    int pc = 0;
+    while( pc < n && steps < eval_budget && eval_out.size() < EVAL_OUTPUT )
+    {
+        int op = program[pc];
+        int cell = eval_tape[eval_idx];
+        int next = pc + 1;
+
+        // mOO runs the command in the cell; anything else ends the program.
+        if( op == 3 )
+        {
+            op = cell;
+            if( op < 0 || op > 11 || op == 3 )
+            {
+                pc = n;
+                steps++;
+                break;
+            }
+        }
+
+        // stop in front of input, and before the tape outgrows EVAL_TAPE.
+        if( (op == 4 && cell == 0) || op == 11 )
+            break;
+        if( op == 2 && eval_idx + 1 == (int)eval_tape.size() && eval_tape.size() >= EVAL_TAPE )
+            break;
+
+        switch( op )
+        {
+        case 0:
+            {
+                int t = match_moo( pc );
+                if( t < 0 )
+                    eval_out.append( "Runtime error.\n\n" );
+                else
+                    next = t;
+            }
+            break;
+
+        case 1:
+            if( eval_idx == 0 )
+                eval_out.append( "Runtime error.\n\n" );
+            else
+                eval_idx--;
+            break;
+
+        case 2:
+            if( ++eval_idx == (int)eval_tape.size() )
+                eval_tape.push_back( 0 );
+            break;
+
+        case 4:
+            eval_out.push_back( (char)cell );
+            break;
+
+        // wrap around like the generated code does in practice.
+        case 5:
+            eval_tape[eval_idx] = (int)((unsigned)cell - 1);
+            break;
+
+        case 6:
+            eval_tape[eval_idx] = (int)((unsigned)cell + 1);
+            break;
+
+        case 7:
+            {
+                int t = match_MOO( pc );
+                if( t < 0 )
+                    eval_out.append( "Runtime error.\n\n" );
+                else if( t < n && cell == 0 )
+                    next = t + 1;
+                else if( cell != 0 && scans[pc] != 0 )
+                {
+                    long at = eval_idx;
+                    if( cow_scan( &eval_tape[0], eval_tape.size(), at, scans[pc] ) )
+                        next = t + 1;
+                    eval_idx = at;
+                }
+                else if( cell != 0 && counted[pc].end >= 0 )
+                {
+                    // in closed form, if the tape already reaches.
+                    const cow_counted& c = counted[pc];
+                    int lo = *std::min_element( c.cells.begin(), c.cells.end() );
+                    int hi = *std::max_element( c.cells.begin(), c.cells.end() );
+                    if( eval_idx + lo >= 0 && eval_idx + hi < (int)eval_tape.size() &&
+                        cow_close( c, &eval_tape[eval_idx] ) )
+                        next = c.end + 1;
+                }
+            }
+            break;
+
+        case 8:
+            eval_tape[eval_idx] = 0;
+            break;
+
+        case 9:
+            if( eval_h )
+                eval_tape[eval_idx] = eval_r;
+            else
+                eval_r = cell;
+            eval_h = !eval_h;
+            break;
+
+        case 10:
+            {
+                char num[16];
+                snprintf( num, sizeof(num), "%d\n", cell );
+                eval_out.append( num );
+            }
+            break;
+        }
+
+        pc = next;
+        steps++;
+    }
+
+    eval_pos = pc;
+    evaluated = steps > 0;
+
+    // trailing zeros are what the tape grows with anyway.
+    int size = eval_tape.size();
+    while( size > eval_idx + 1 && eval_tape[size - 1] == 0 )
+        size--;
+    eval_tape.resize( size );
+
+    // resuming inside a region can skip its checks if the tape around where
+    // the region was entered is big enough, which is made so here.
+    resume_unchecked = false;
+    int h = pc < n ? region_head[pc] : -1;
+    if( evaluated && !use_llvm && h >= 0 && h != pc )
+    {
+        int entry = eval_idx - region_offset[pc];
+        if( entry + regions[h].lo >= 0 )
+        {
+            resume_unchecked = true;
+            if( (int)eval_tape.size() < entry + regions[h].hi + 1 )
+                eval_tape.resize( entry + regions[h].hi + 1, 0 );
+        }
+    }
+}
+
+// the output made by evaluate() as eo[], and with tape, its tape as et[].
+void eval_data( bool tape )
+{
+    emit( "static const char eo[]=\"" );
+    for( size_t i = 0; i < eval_out.size(); i++ )
+    {
+        unsigned char c = eval_out[i];
+        if( i > 0 && i % 64 == 0 )
+            emit( "\"\n\"" );
+        // always three octal digits, so a digit after it can't join in.
+        if( c < ' ' || c > '~' || c == '"' || c == '\\' || c == '?' )
+            emit( "\\%03o", c );
+        else
+            emit( "%c", c );
+    }
+    emit( "\";\n" );
+
+    if( !tape || eval_pos == (int)program.size() )
+        return;
+
+    emit( "static const int et[]={" );
+    for( size_t i = 0; i < eval_tape.size(); i++ )
+        emit( i % 16 == 15 ? "%d,\n" : "%d,", eval_tape[i] );
+    emit( "};\n" );
+}
+
+// statements that write eo[] and, with tape, continue from the evaluated
+// state: the restored tape and a jump to s, or straight to the end.
+void eval_start( bool tape )
+{
+    if( !eval_out.empty() )
+        emit( "for(int i=0;i<%d;i++)oc(eo[i]);\n", (int)eval_out.size() );
+    if( !tape )
+        return;
+
+    if( eval_pos == (int)program.size() )
+        emit( "goto x;\n" );
+    else
+        emit( "m.assign(et,et+%d);p=m.begin()+%d;h=%s;r=%d;goto s;\n",
+              (int)eval_tape.size(), eval_idx, eval_h ? "true" : "false", eval_r );
+}
+
+bool body( int from, int to )
+{
+    prog_pos = program.begin() + from;
+    while( prog_pos != program.begin() + to )
+    {
+        int pos = prog_pos - program.begin();
+
+        // in a region the resume point is in one of its two copies.
+        if( evaluated && pos == eval_pos &&
+            (in_region < 0 || (pos != in_region && unchecked == resume_unchecked)) )
+            emit( use_llvm ? "br label %%s\ns:\n" : "s:;" );
+
+        if( !use_llvm && in_region < 0 && regions[pos].end >= 0 )
+        {
+            int end = regions[pos].end;
+            in_region = pos;
+            emit( "if(tb(%d,%d)){", -regions[pos].lo, regions[pos].hi );
+            unchecked = true;
+            bool ok = body( pos, end + 1 );
+            emit( "}else{" );
+            unchecked = false;
+            ok = ok && body( pos, end + 1 );
+            emit( "}" );
+            in_region = -1;
+            if( !ok )
+                return false;
+            continue;
+        }
+
+        if( !(use_llvm ? compile_llvm : compile)( *prog_pos, true ) )
+            return false;
+    }
+    return true;
+}
+
+// start a new file, with room for about bytes of code.
+void code_begin( size_t bytes )
+{
+    code_len = 0;
+    code_reserve( bytes );
+}
+
+bool code_write( const char* path )
+{
+    FILE* f = fopen( path, "wb" );
+    if( f == NULL )
+    {
+        printf( "Cannot write [%s].\n", path );
+        return false;
+    }
+
+    bool ok = fwrite( code, 1, code_len, f ) == code_len;
+    return fclose( f ) == 0 && ok;
+}
+
+// translate the parsed program into C++ source at path.
+bool generate( const char* path )
+{
+    code_begin( program.size() * CODE_PER_COMMAND );
+
+    exit_stmt = "goto x;";
+    find_matches();
+    find_loops();
+    evaluate();
+    prelude( true );
+    if( evaluated )
+        eval_data( true );
+    entry();
+    if( evaluated )
+        eval_start( true );
+
+    if( eval_pos < (int)program.size() && !body( 0, program.size() ) )
+        return false;
+
+    emit( "x:of();return(0);}\n" );
+    return code_write( path );
+}
+
+// translate the program into a main file plus one file per part, each
+// holding whole functions cut at top level loop boundaries.
+bool generate_split( const std::vector<std::string>& paths )
+{
+    int n = program.size();
+    int parts = paths.size() - 1;
+    find_matches();
+    evaluated = false;
+    std::vector<bool> cuts = find_cuts();
+    find_loops();
+
+    std::vector<int> starts;
+    starts.push_back( 0 );
+    for( int c = 1; c < n; c++ )
+        if( cuts[c] && c - starts.back() >= SPLIT_FUNC )
+            starts.push_back( c );
+    starts.push_back( n );
+    int funcs = starts.size() - 1;
+
+    exit_stmt = "return 0;";
+    for( int k = 0, f = 0; k < parts; k++ )
+    {
+        code_begin( (size_t)n / parts * CODE_PER_COMMAND );
+        prelude( false );
+        // spread functions by position so each part gets a similar share.
+        for( ; f < funcs && (k == parts - 1 || (long long)starts[f] * parts < (long long)(k + 1) * n); f++ )
+        {
+            emit( "int f%d(){\n", f );
+            if( !body( starts[f], starts[f + 1] ) )
+                return false;
+            emit( "return 1;}\n" );
+        }
+
+        if( !code_write( paths[k + 1].c_str() ) )
+            return false;
+    }
+
+    code_begin( funcs * 32 );
+    prelude( true );
+    for( int f = 0; f < funcs; f++ )
+        emit( "int f%d();\n", f );
+    entry();
+    for( int f = 0; f < funcs; f++ )
+        emit( "if(!f%d())goto x;\n", f );
+    emit( "x:of();return(0);}\n" );
+    return code_write( paths[0].c_str() );
+}
+
+// translate the program into LLVM IR defining cow_body(), plus a C++ file
+// with the runtime and the real entry point that calls it.
+bool generate_llvm( const std::vector<std::string>& paths )
+{
+    int n = program.size();
+    code_begin( program.size() * CODE_PER_COMMAND * 4 );
+
+    find_matches();
+    find_loops();
+    evaluate();
+    ir_loops.clear();
+    ir_io.assign( n + 1, 0 );
+    for( int i = 0; i < n; i++ )
+    {
+        int op = program[i];
+        ir_io[i + 1] = ir_io[i] + (op == 3 || op == 4 || op == 10 || op == 11);
+    }
+
+    // the I/O helpers only touch runtime state this module can't see.
+    emit( "declare noalias %s @cow_grow(%s nocapture,i64,i64) nounwind\n", ir_i32p, ir_i32p );
+    emit( "declare void @cow_oc(i32) nounwind inaccessiblememonly\n" );
+    emit( "declare i32 @cow_in() nounwind inaccessiblememonly\n" );
+    emit( "declare void @cow_od(i32) nounwind inaccessiblememonly\n" );
+    emit( "declare i32 @cow_ri() nounwind inaccessiblememonly\n" );
+    emit( "declare void @cow_errs(i64) nounwind inaccessiblememonly\n" );
+    emit( "declare i64 @cow_sc(%s nocapture readonly,i64,i64,i32) nounwind readonly\n", ir_i32p );
+    emit( "declare void @free(%s nocapture) nounwind\n", ir_i8p );
+    emit( "declare void @%s(%s nocapture,%s nocapture,i64,i1)\n", ir_memcpy, ir_i8p, ir_i8p );
+
+    // the tape left by evaluate().
+    bool resume = evaluated && eval_pos < n;
+    int cells = resume ? eval_tape.size() : 0;
+    if( resume )
+    {
+        emit( "@et=private unnamed_addr constant [%d x i32] [", cells );
+        for( int i = 0; i < cells; i++ )
+            emit( i + 1 == cells ? "i32 %d" : i % 16 == 15 ? "i32 %d,\n" : "i32 %d,", eval_tape[i] );
+        emit( "]\n" );
+    }
+
+    int cap = std::max( cells, 1024 );
+    emit( "define hidden i32 @cow_body(){\n" );
+    emit( "%%base=alloca %s\n%%idx=alloca i64\n%%cap=alloca i64\n%%h=alloca i1\n%%r=alloca i32\n", ir_i32p );
+    emit( "%%t0=call %s @cow_grow(%s null,i64 0,i64 %d)\n", ir_i32p, ir_i32p, cap );
+    emit( "store %s %%t0,%s %%base\n", ir_i32p, ir_i32pp );
+    emit( "store i64 0,%s %%idx\nstore i64 %d,%s %%cap\n", ir_i64p, cap, ir_i64p );
+    emit( "store i1 false,%s %%h\nstore i32 0,%s %%r\n", ir_i1p, ir_i32p );
+    ir_next = 2;
+
+    if( resume )
+    {
+        emit( "%%t1=bitcast %s %%t0 to %s\n", ir_i32p, ir_i8p );
+        if( ir_opaque )
+            emit( "call void @%s(ptr %%t1,ptr @et,i64 %d,i1 false)\n", ir_memcpy, cells * 4 );
+        else
+            emit( "call void @%s(i8* %%t1,i8* bitcast([%d x i32]* @et to i8*),i64 %d,i1 false)\n",
+                  ir_memcpy, cells, cells * 4 );
+        emit( "store i64 %d,%s %%idx\nstore i1 %s,%s %%h\nstore i32 %d,%s %%r\n",
+              eval_idx, ir_i64p, eval_h ? "true" : "false", ir_i1p, eval_r, ir_i32p );
+        emit( "br label %%s\nu:\n" );
+    }
+
+    if( evaluated && !resume )
+        emit( "br label %%x\nu:\n" );
+    else if( !body( 0, n ) )
+        return false;
+
+    emit( "br label %%x\nx:\n" );
+    emit( "%%t%d=load %s,%s %%base\n", ir_next, ir_i32p, ir_i32pp );
+    emit( "%%t%d=bitcast %s %%t%d to %s\n", ir_next + 1, ir_i32p, ir_next, ir_i8p );
+    emit( "call void @free(%s %%t%d)\nret i32 0\n}\n", ir_i8p, ir_next + 1 );
+
+    // !0 marks a branch as rarely taken.  Loops doing I/O gain nothing from
+    // unrolling, so it is turned off for them.
+    emit( "!0=!{!\"branch_weights\",i32 1,i32 2000}\n" );
+    emit( "!1=!{!\"llvm.loop.unroll.disable\"}\n" );
+    for( int i = 0; i < (int)ir_loops.size(); i++ )
+    {
+        if( ir_loops[i] )
+            emit( "!%d=distinct !{!%d,!1}\n", i + 2, i + 2 );
+        else
+            emit( "!%d=distinct !{!%d}\n", i + 2, i + 2 );
+    }
+    if( !code_write( paths[0].c_str() ) )
+        return false;
+
+    code_begin( 4096 + eval_out.size() * 4 );
+    prelude( true );
+    if( evaluated )
+        eval_data( false );
+    emit( "extern \"C\"{int cow_body();\n" );
+    emit( "int* cow_grow(int* t,long o,long n){t=(int*)realloc(t,n*sizeof(int));" );
+    emit( "if(t==NULL){os(\"Out of memory.\\n\");of();exit(1);}" );
+    emit( "memset(t+o,0,(n-o)*sizeof(int));return t;}\n" );
+    emit( "void cow_oc(int c){oc(c);}\n" );
+    emit( "int cow_in(){int c=ic();il();return c;}\n" );
+    emit( "void cow_od(int d){od(d);}\n" );
+    emit( "int cow_ri(){return ri();}\n" );
+    emit( "void cow_errs(long n){while(n--)rterr();}\n" );
+    emit( "long cow_sc(const int* t,long n,long a,int s){if(t[a])sc(t,n,a,s);return a;}}\n" );
+    entry();
+    if( evaluated )
+        eval_start( false );
+    emit( "int e=cow_body();of();return e;}\n" );
+    return code_write( paths[1].c_str() );
+}
+
+const char* artifact()
+{
+    return shared_lib ? ".so" : ".out";
+}
+
+const char* artifact_name()
+{
+    return shared_lib ? "Shared object" : "Executable";
+}
+
+const char* source_kind()
+{
+    return use_llvm ? "LLVM IR and runtime" : "C++ source code";
+}
+
+// one program being built.  The executable is built under a private name
+// and renamed into place so concurrent cowcomp runs never see a partial file.
+struct build
+{
+    std::string source;
+    std::string exec;
+    std::string part;
+    std::string key;
+    std::string work;
+    bool have_profile;
+    std::vector<std::string> cpps;
+    std::vector<std::string> keep;  // where to leave each source, if anywhere
+    std::vector<std::string> objs;  // split mode only
+    double start;
+    double end;
+    bool ok;
+};
+
+// one compiler process.
+struct job
+{
+    int build;
+    std::string cmd;
+    pid_t pid;
+};
+
+std::string cxx( const std::string& out, const char* extra, const std::string& in )
+{
+    std::string path( (const char*)COMPILER );
+    path.append( " " );
+    path.append( (const char*)NAME_FLAG );
+    path.append( " " );
+    path.append( quote( out ) );
+    path.append( " " );
+    path.append( extra );
+    path.append( " " );
+    path.append( (const char*)FLAGS );
+    path.append( " " );
+    path.append( quote( in ) );
+    return path;
+}
+
+// clang if it's installed, otherwise opt piped into llc.
+std::string llvm_command( const std::string& out, const std::string& in )
+{
+    std::string cmd( "if command -v clang >/dev/null 2>&1; then " LLVM_CLANG " " NAME_FLAG " " );
+    cmd.append( quote( out ) );
+    cmd.append( " " );
+    cmd.append( quote( in ) );
+    cmd.append( "; else " LLVM_OPT " " );
+    cmd.append( quote( in ) );
+    cmd.append( " | " LLVM_LLC " " NAME_FLAG " " );
+    cmd.append( quote( out ) );
+    cmd.append( "; fi" );
+    return cmd;
+}
+
+// find which LLVM will build the IR, the same way llvm_command() does, and
+// pick its pointer types.  With -S and no LLVM around, write for a new one.
+void llvm_check( bool needed )
+{
+    FILE* f = popen( LLVM_VERSION, "r" );
+    char line[256];
+    while( f != NULL && llvm_version == 0 && fgets( line, sizeof(line), f ) != NULL )
+    {
+        const char* at = strstr( line, "version " );
+        if( at != NULL )
+            llvm_version = atoi( at + 8 );
+    }
+    if( f != NULL )
+        pclose( f );
+
+    if( llvm_version == 0 && needed )
+    {
+        printf( "-llvm needs clang, or opt and llc.\n" );
+        exit( 1 );
+    }
+    ir_opaque = llvm_version == 0 || llvm_version >= 15;
+    if( ir_opaque )
+    {
+        ir_i32p = ir_i32pp = ir_i64p = ir_i1p = ir_i8p = "ptr";
+        ir_memcpy = "llvm.memcpy.p0.p0.i64";
+    }
+}
+
+std::string link_command( const build& b )
+{
+    std::string cmd( COMPILER " " NAME_FLAG " " );
+    cmd.append( quote( b.part ) );
+    if( shared_lib )
+        cmd.append( " -shared" );
+    for( size_t i = 0; i < b.objs.size(); i++ )
+    {
+        cmd.append( " " );
+        cmd.append( quote( b.objs[i] ) );
+    }
+    return cmd;
+}
+
+// profile guided builds happen in a private directory with fixed names so
+// the profile written by the instrumented run is always pgo.gcda.  Compiling
+// and linking separately keeps that name the same across gcc versions.
+std::string pgo_command( const build& b )
+{
+    std::string cmd( "cd " );
+    cmd.append( quote( b.work ) );
+    cmd.append( " && " );
+    if( !b.have_profile )
+    {
+        cmd.append( cxx( "pgo.o", "-c " PGO_GENERATE, "pgo.cpp" ) );
+        // a training run that exits nonzero still leaves a usable profile
+        cmd.append( " && " COMPILER " " NAME_FLAG " pgo " PGO_GENERATE " pgo.o && (./pgo < " );
+        cmd.append( quote( training ) );
+        cmd.append( " > /dev/null || true) && " );
+    }
+    cmd.append( cxx( "pgo.o", "-c " PGO_USE, "pgo.cpp" ) );
+    cmd.append( " && " COMPILER " " NAME_FLAG " pgo pgo.o" );
+    return cmd;
+}
+
+// the processes that turn a program's sources into b.part, or into objects
+// still to be linked.
+void add_jobs( std::vector<job>& jobs, int index, const build& b )
+{
+    job j;
+    j.build = index;
+    j.pid = 0;
+
+    if( !b.work.empty() )
+    {
+        j.cmd = pgo_command( b );
+        jobs.push_back( j );
+    }
+    else if( b.objs.empty() )
+    {
+        j.cmd = cxx( b.part, shared_lib ? SHARED_FLAGS : "", b.cpps[0] );
+        jobs.push_back( j );
+    }
+    else
+        for( size_t i = 0; i < b.objs.size(); i++ )
+        {
+            if( use_llvm && i == 0 )
+                j.cmd = llvm_command( b.objs[i], b.cpps[i] );
+            else
+                j.cmd = cxx( b.objs[i], shared_lib ? "-c " SHARED_FLAGS : "-c", b.cpps[i] );
+            jobs.push_back( j );
+        }
+}
+
+void remove_work( const build& b )
+{
+    const char* files[] = { "pgo.cpp", "pgo.o", "pgo", "pgo.gcda" };
+    for( size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++ )
+        unlink( (b.work + "/" + files[i]).c_str() );
+    rmdir( b.work.c_str() );
+}
+
+void finish( build& b )
+{
+    if( b.ok && !b.work.empty() )
+    {
+        if( cache_dir != NULL && !b.have_profile )
+            cache_store( b.key, ".gcda", (b.work + "/pgo.gcda").c_str() );
+        b.ok = move_file( (b.work + "/pgo").c_str(), b.part.c_str() );
+    }
+    if( b.ok )
+        b.ok = rename( b.part.c_str(), b.exec.c_str() ) == 0;
+    else
+        unlink( b.part.c_str() );
+
+    if( b.ok && cache_dir != NULL )
+        cache_store( b.key, artifact(), b.exec.c_str() );
+    for( size_t i = 0; i < b.cpps.size(); i++ )
+        if( b.keep[i].empty() || !move_file( b.cpps[i].c_str(), b.keep[i].c_str() ) )
+            unlink( b.cpps[i].c_str() );
+    for( size_t i = 0; i < b.objs.size(); i++ )
+        unlink( b.objs[i].c_str() );
+    if( !b.work.empty() )
+        remove_work( b );
+}
+
+// run the compiles, at most max_jobs at a time.  A build fails if any of
+// its processes does.
+void run_jobs( std::vector<job>& jobs, std::vector<build>& builds, int max_jobs )
+{
+    size_t next = 0;
+    int running = 0;
+
+    while( next < jobs.size() || running > 0 )
+    {
+        if( next < jobs.size() && running < max_jobs )
+        {
+            job& j = jobs[next++];
+            build& b = builds[j.build];
+            if( b.start == 0 )
+                b.start = now();
+            j.pid = fork();
+            if( j.pid == 0 )
+            {
+                execl( "/bin/sh", "sh", "-c", j.cmd.c_str(), (char*)NULL );
+                _exit( 127 );
+            }
+            if( j.pid < 0 )
+            {
+                b.ok = false;
+                b.end = now();
+            }
+            else
+                running++;
+            continue;
+        }
+
+        int status;
+        pid_t pid = wait( &status );
+        if( pid < 0 )
+            break;
+        for( size_t i = 0; i < next; i++ )
+            if( jobs[i].pid == pid )
+            {
+                build& b = builds[jobs[i].build];
+                jobs[i].pid = 0;
+                if( !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+                    b.ok = false;
+                b.end = now();
+                running--;
+                break;
+            }
+    }
+}
+
+// foo.cow -> foo.out
+std::string exec_name( const std::string& source )
+{
+    std::string name( source );
+    size_t dot = name.rfind( '.' );
+    if( dot != std::string::npos && name.find( '/', dot ) == std::string::npos )
+        name.erase( dot );
+    return name + artifact();
+}
+
+// a name no other cowcomp process will pick.
+std::string temp_name( const std::string& prefix, const char* suffix )
+{
+    static int n = 0;
+    char name[64];
+    snprintf( name, sizeof(name), ".%d.%d%s", (int)getpid(), n++, suffix );
+    return prefix + name;
+}
+
+
+int read_stdin( void*, char* buf, int len )
+{
+    // read() rather than fread() so interactive input isn't held up.
+    int n = read( 0, buf, len );
+    return n < 0 ? 0 : n;
+}
+
+void write_stdout( void*, const char* buf, int len )
+{
+    fwrite( buf, 1, len, stdout );
+}
+
+// load a shared object built by -shared and run it on stdin and stdout.
+int run( const char* path )
+{
+    void* handle;
+    cow_run_t cow_run = cow_load( path, &handle );
+    if( cow_run == NULL )
+    {
+        printf( "Cannot load [%s]: %s\n", path, dlerror() );
+        return 1;
+    }
+
+    cow_ctx ctx;
+    ctx.user = NULL;
+    ctx.read = read_stdin;
+    ctx.write = write_stdout;
+
+    fflush( stdout );
+    int result = cow_run( &ctx );
+    fflush( stdout );
+    dlclose( handle );
+    return result;
+}
+
+
+void usage( const char* self )
+{
+    printf( "Usage: %s [options] program.cow ...\n\n", self );
+    printf( "  -o file          name of the executable (single program only)\n" );
+    printf( "  -j n             run at most n C++ compiles at once\n" );
+    printf( "  -pgo input       profile a run fed from input, then rebuild using the profile\n" );
+    printf( "  -split n         spread the program over n C++ files compiled in parallel\n" );
+    printf( "  -goto            emit every loop as labels and gotos, not while loops\n" );
+    printf( "  -ddx             accept the Distributed Digestion eXtensions (ddx/ddx.txt)\n" );
+    printf( "  -llvm            emit LLVM IR and build it with clang, or opt and llc\n" );
+    printf( "  -shared          build a shared object exposing cow_run() (see cow_run.h)\n" );
+    printf( "  -run             build a shared object, then load and run it in this process\n" );
+    printf( "  -eval n          run up to n commands at compile time, until input is needed (default %d, 0 for none)\n", EVAL_BUDGET );
+    printf( "  -S               stop after writing the C++ source\n" );
+    printf( "  -time            report how fast the program was translated\n" );
+    printf( "  -cache dir       reuse executables built from identical programs (or set %s)\n", CACHE_ENV );
+    printf( "  -cache-size n    evict least recently used entries above n bytes\n\n" );
+    printf( "With more than one program each foo.cow is built as foo.out (or foo.so).\n\n" );
+    exit( 1 );
+}
+
+
+int main( int argc, char** argv )
+{
+    std::vector<const char*> sources;
+    const char* exec = NULL;
+    int max_jobs = (int)sysconf( _SC_NPROCESSORS_ONLN );
+    cache_dir = getenv( CACHE_ENV );
+
+    for( int i = 1; i < argc; i++ )
+    {
+        if( !strcmp( argv[i], "-cache" ) && i + 1 < argc )
+            cache_dir = argv[++i];
+        else if( !strcmp( argv[i], "-cache-size" ) && i + 1 < argc )
+            cache_size = atoll( argv[++i] );
+        else if( !strcmp( argv[i], "-j" ) && i + 1 < argc )
+            max_jobs = atoi( argv[++i] );
+        else if( !strcmp( argv[i], "-o" ) && i + 1 < argc )
+            exec = argv[++i];
+        else if( !strcmp( argv[i], "-pgo" ) && i + 1 < argc )
+            training = argv[++i];
+        else if( !strcmp( argv[i], "-eval" ) && i + 1 < argc )
+            eval_budget = atoll( argv[++i] );
+        else if( !strcmp( argv[i], "-split" ) && i + 1 < argc )
+            split = atoi( argv[++i] );
+        else if( !strcmp( argv[i], "-goto" ) )
+            use_goto = true;
+        else if( !strcmp( argv[i], "-ddx" ) )
+            ddx = true;
+        else if( !strcmp( argv[i], "-llvm" ) )
+            use_llvm = true;
+        else if( !strcmp( argv[i], "-shared" ) )
+            shared_lib = true;
+        else if( !strcmp( argv[i], "-run" ) )
+            shared_lib = run_program = true;
+        else if( !strcmp( argv[i], "-S" ) )
+            source_only = true;
+        else if( !strcmp( argv[i], "-time" ) )
+            show_time = true;
+        else if( argv[i][0] == '-' )
+            usage( argv[0] );
+        else
+            sources.push_back( argv[i] );
+    }
+
+    if( sources.empty() || (exec != NULL && sources.size() > 1) )
+        usage( argv[0] );
+    if( split < 0 || (split > 0 && training != NULL) )
+        usage( argv[0] );
+    if( use_llvm && (split > 0 || training != NULL || ddx) )
+        usage( argv[0] );
+    if( (shared_lib && training != NULL) || (run_program && sources.size() > 1) )
+        usage( argv[0] );
+    if( source_only && (training != NULL || run_program) )
+        usage( argv[0] );
+    if( use_llvm )
+        llvm_check( !source_only );
+    if( source_only )
+        cache_dir = NULL;
+    if( cache_dir != NULL && cache_dir[0] == 0 )
+        cache_dir = NULL;
+    if( max_jobs < 1 )
+        max_jobs = 1;
+
+    // the training run happens in another directory.
+    char training_path[PATH_MAX];
+    if( training != NULL )
+    {
+        if( realpath( training, training_path ) == NULL )
+        {
+            printf( "Cannot open training input [%s].\n", training );
+            exit( 1 );
+        }
+        training = training_path;
+    }
+
+    const char* tmpdir = getenv( "TMPDIR" );
+    if( tmpdir == NULL || tmpdir[0] == 0 )
+        tmpdir = "/tmp";
+
+    bool batch = sources.size() > 1;
+    std::vector<build> builds;
+    int failed = 0;
+
+    // translating is cheap, so do every program up front and keep the
+    // cores for the C++ compiler.
+    for( size_t i = 0; i < sources.size(); i++ )
+    {
+        build b;
+        b.source = sources[i];
+        b.exec = batch ? exec_name( b.source ) : (exec ? exec : shared_lib ? OUTPUT_SO : OUTPUT_EXEC);
+        b.part = temp_name( b.exec, ".part" );
+        b.have_profile = false;
+        b.start = 0;
+        b.end = 0;
+        b.ok = true;
+
+        if( !parse( sources[i] ) )
+        {
+            failed++;
+            continue;
+        }
+
+        if( cache_dir != NULL )
+        {
+            b.key = cache_key();
+            if( cache_fetch( b.key, artifact(), b.exec.c_str() ) )
+            {
+                printf( "%s created: %s (cached)\n", artifact_name(), b.exec.c_str() );
+                continue;
+            }
+        }
+
+        printf( "Compiling [%s]...\n", sources[i] );
+
+        if( training != NULL )
+        {
+            b.work = temp_name( std::string( tmpdir ) + "/cow", ".pgo" );
+            if( mkdir( b.work.c_str(), 0700 ) != 0 )
+            {
+                printf( "Cannot create [%s].\n", b.work.c_str() );
+                failed++;
+                continue;
+            }
+            b.cpps.push_back( b.work + "/pgo.cpp" );
+
+            // a cached profile saves the instrumented build and training run.
+            if( cache_dir != NULL )
+                b.have_profile = cache_fetch( b.key, ".gcda", (b.work + "/pgo.gcda").c_str() );
+        }
+        else
+        {
+            // with -llvm the first file is the IR, the second the runtime.
+            for( int k = 0; k <= (use_llvm ? 1 : split); k++ )
+            {
+                bool ir = use_llvm && k == 0;
+                if( batch )
+                    b.cpps.push_back( temp_name( std::string( tmpdir ) + "/cow", ir ? ".ll" : ".cpp" ) );
+                else
+                    b.cpps.push_back( temp_name( ir ? OUTPUT_LL : OUTPUT_CPP, ".part" ) );
+                if( split || use_llvm )
+                    b.objs.push_back( temp_name( std::string( tmpdir ) + "/cow", ".o" ) );
+            }
+        }
+
+        // cow.out.cpp, cow.out.1.cpp, ... or foo.out.cpp, ... with -S.  -llvm
+        // gives cow.out.ll and cow.out.1.cpp.
+        for( int k = 0; k < (int)b.cpps.size(); k++ )
+        {
+            std::string name( batch ? b.exec : OUTPUT_EXEC );
+            if( k > 0 )
+            {
+                char n[16];
+                snprintf( n, sizeof(n), ".%d", k );
+                name.append( n );
+            }
+            name.append( use_llvm && k == 0 ? ".ll" : ".cpp" );
+            b.keep.push_back( batch && !source_only ? "" : name );
+        }
+
+        double t = now();
+        bool ok;
+        if( use_llvm )
+            ok = generate_llvm( b.cpps );
+        else
+            ok = split ? generate_split( b.cpps ) : generate( b.cpps[0].c_str() );
+        t = now() - t;
+        if( show_time )
+            printf( "Translated %d instructions in %.3fs (%.0f instructions/s)\n",
+                    (int)program.size(), t, t > 0 ? program.size() / t : 0.0 );
+        if( !ok )
+        {
+            b.ok = false;
+            finish( b );
+            failed++;
+            continue;
+        }
+
+        if( source_only )
+        {
+            printf( "%s:", source_kind() );
+            for( size_t k = 0; k < b.cpps.size(); k++ )
+            {
+                move_file( b.cpps[k].c_str(), b.keep[k].c_str() );
+                printf( " %s", b.keep[k].c_str() );
+            }
+            printf( "\n" );
+            continue;
+        }
+
+        builds.push_back( b );
+    }
+
+    #ifdef COMPILER
+        double start = now();
+        std::vector<job> jobs;
+        for( size_t i = 0; i < builds.size(); i++ )
+            add_jobs( jobs, i, builds[i] );
+        run_jobs( jobs, builds, max_jobs );
+
+        // split programs still need linking.
+        jobs.clear();
+        for( size_t i = 0; i < builds.size(); i++ )
+            if( builds[i].ok && !builds[i].objs.empty() )
+            {
+                job j;
+                j.build = i;
+                j.cmd = link_command( builds[i] );
+                j.pid = 0;
+                jobs.push_back( j );
+            }
+        run_jobs( jobs, builds, max_jobs );
+
+        for( size_t i = 0; i < builds.size(); i++ )
+        {
+            build& b = builds[i];
+            finish( b );
+            if( !b.ok )
+            {
+                failed++;
+                printf( "\n\nCould not compile [%s].  Possible causes:  C++ compiler is not installed, not in path, or not named '%s' or there is a bug in this compiler.\n\n", b.source.c_str(), COMPILER );
+            }
+            else if( batch )
+                printf( "%s created: %s (%.2fs)\n", artifact_name(), b.exec.c_str(), b.end - b.start );
+            else
+            {
+                printf( "%s:", source_kind() );
+                for( int k = 0; k < (int)b.keep.size(); k++ )
+                    printf( " %s", b.keep[k].c_str() );
+                printf( "\n" );
+                printf( "%s created: %s\n", artifact_name(), b.exec.c_str() );
+            }
+        }
+
+        if( batch )
+            printf( "%d of %d programs built in %.2fs using %d jobs.\n",
+                    (int)sources.size() - failed, (int)sources.size(), now() - start, max_jobs );
+    #endif
+
+    if( run_program && !failed )
+        return run( exec ? exec : OUTPUT_SO );
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,990 @@
+//--------------------------------------------
+// COW PROGRAMMING LANGUAGE
+// Program analysis shared by the interpreter and the compiler.
+//
+// License: Public Domain
+//--------------------------------------------
+#ifndef COWOPT_H
+#define COWOPT_H
+
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <limits.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+// where a moo (or a mOO acting as one) at each position jumps back to, and
+// where a MOO skips to, the way the interpreter scans for them.  moo_to[i]
+// is the MOO's index or -1.  MOO_to[i] is the moo to continue after,
+// program.size() if there is nothing left, or -1.
+//
+// Going back, a moo at pos matches the last MOO before pos-1 where the
+// running MOO-minus-moo count drops to one below its value at pos-1.
+// Going forward the count is the same except that a moo straight after a
+// MOO counts twice, and the scan stops where it first falls below its
+// value at pos+2.
+inline void cow_match( const std::vector<int>& program, std::vector<int>& moo_to, std::vector<int>& MOO_to )
+{
+    int n = program.size();
+    moo_to.assign( n, -1 );
+    MOO_to.assign( n, -1 );
+
+    // depth[t] counts MOO minus moo in program[0..t).  last[d + n] is the
+    // latest t seen with depth[t] == d.
+    std::vector<int> last( 2 * n + 2, -1 );
+    int depth = 0;
+    for( int t = 0; t < n; t++ )
+    {
+        // t is the skipped command for whatever is at t + 1.
+        if( t + 1 < n )
+            moo_to[t + 1] = last[depth - 1 + n];
+        last[depth + n] = t;
+
+        if( program[t] == 7 )
+            depth++;
+        else
+        if( program[t] == 0 )
+            depth--;
+    }
+
+    // level[t] is the forward count over program[1..t).
+    std::vector<int> level( n + 1, 0 );
+    for( int t = 1; t < n; t++ )
+    {
+        int d = 0;
+        if( program[t] == 7 )
+            d = 1;
+        else
+        if( program[t] == 0 )
+            d = program[t - 1] == 7 ? -2 : -1;
+        level[t + 1] = level[t] + d;
+    }
+
+    // the next b > a with level[b] < level[a], kept on a stack while
+    // walking backwards.
+    std::vector<int> below( n + 1, -1 );
+    std::vector<int> stack;
+    for( int a = n; a >= 1; a-- )
+    {
+        while( !stack.empty() && level[stack.back()] >= level[a] )
+            stack.pop_back();
+        below[a] = stack.empty() ? -1 : stack.back();
+        stack.push_back( a );
+    }
+
+    for( int pos = 0; pos < n; pos++ )
+    {
+        int a = pos + 2;
+        if( pos + 1 >= n )
+            MOO_to[pos] = n;
+        else
+        if( a < n && below[a] != -1 && level[below[a]] == level[a] - 1 )
+            MOO_to[pos] = below[a] - 1;
+    }
+}
+
+// the loops that behave like while loops: a MOO and moo that match each
+// other, that nothing else (a mOO, or an odd bracket) jumps to, and that
+// nest properly inside each other.  other[i] is the partner of each such
+// MOO and moo, -1 for everything else.
+inline void cow_loops( const std::vector<int>& program, const std::vector<int>& moo_to,
+                       const std::vector<int>& MOO_to, std::vector<int>& other )
+{
+    int n = program.size();
+    std::vector<int> refs( n, 0 );
+    other.assign( n, -1 );
+
+    for( int i = 0; i < n; i++ )
+    {
+        if( program[i] == 0 || program[i] == 3 )
+        {
+            int t = moo_to[i];
+            if( t >= 0 )
+                refs[t]++;
+        }
+        if( program[i] == 7 || program[i] == 3 )
+        {
+            int t = MOO_to[i];
+            if( t >= 0 && t < n )
+                refs[t]++;
+        }
+    }
+
+    for( int i = 0; i < n; i++ )
+    {
+        if( program[i] != 7 )
+            continue;
+        int j = MOO_to[i];
+        if( j > i && j < n && moo_to[j] == i && refs[i] == 1 && refs[j] == 1 )
+        {
+            other[i] = j;
+            other[j] = i;
+        }
+    }
+
+    // demote loops that would close the wrong brace until none are left.
+    bool changed = true;
+    while( changed )
+    {
+        changed = false;
+        std::vector<int> open;
+        for( int i = 0; i < n && !changed; i++ )
+        {
+            if( other[i] < 0 )
+                continue;
+            if( program[i] == 7 )
+                open.push_back( i );
+            else if( !open.empty() && open.back() == other[i] )
+                open.pop_back();
+            else
+            {
+                other[other[i]] = -1;
+                other[i] = -1;
+                changed = true;
+            }
+        }
+    }
+}
+
+// commands only the interpreter uses: mOo and moO inside a region, where
+// the tape is known to be big enough.
+#define COW_LEFT	32
+#define COW_RIGHT	33
+
+// a loop whose pointer ends every pass where it started, so wherever the
+// loop goes the pointer stays within lo..hi cells of where it was on
+// entry.  One check there covers every move inside.
+struct cow_region
+{
+    int end;    // the moo closing it, or -1 if this is no region
+    int lo;
+    int hi;
+};
+
+// find the outermost regions among the loops from cow_loops().  For every
+// command inside one, head[k] is the region's MOO and offset[k] how far
+// the pointer is from where it was on entry; head[k] is -1 elsewhere.
+// Loops with a mOO in them never qualify, nor under DDX loops that switch
+// stomachs or move them all, so a region keeps to one stomach's tape.
+inline void cow_regions( const std::vector<int>& program, const std::vector<int>& other,
+                         std::vector<cow_region>& regions, std::vector<int>& head, std::vector<int>& offset )
+{
+    int n = program.size();
+    cow_region none = { -1, 0, 0 };
+    regions.assign( n, none );
+    head.assign( n, -1 );
+    offset.assign( n, 0 );
+
+    // inner loops come later in the program, so going backwards they are
+    // done before the loops around them.
+    std::vector<bool> balanced( n, false );
+    for( int i = n - 1; i >= 0; i-- )
+    {
+        int j = other[i];
+        if( program[i] != 7 || j < 0 )
+            continue;
+
+        int d = 0, lo = 0, hi = 0;
+        bool ok = true;
+        for( int k = i + 1; k < j && ok; k++ )
+        {
+            switch( program[k] )
+            {
+            case 1:
+                lo = std::min( lo, --d );
+                break;
+            case 2:
+                hi = std::max( hi, ++d );
+                break;
+            case 7:
+                ok = balanced[k];
+                if( ok )
+                {
+                    lo = std::min( lo, d + regions[k].lo );
+                    hi = std::max( hi, d + regions[k].hi );
+                    k = other[k];
+                }
+                break;
+            case 0:
+            case 3:
+            case 12:
+            case 13:
+            case 14:
+            case 15:
+                ok = false;
+                break;
+            }
+        }
+
+        if( ok && d == 0 )
+        {
+            balanced[i] = true;
+            regions[i].lo = lo;
+            regions[i].hi = hi;
+        }
+    }
+
+    for( int i = 0; i < n; i++ )
+    {
+        if( !balanced[i] )
+            continue;
+
+        int j = other[i];
+        regions[i].end = j;
+
+        // inner loops end where they started, so walking straight through
+        // gives the right offset everywhere.
+        int d = 0;
+        for( int k = i; k <= j; k++ )
+        {
+            head[k] = i;
+            offset[k] = d;
+            if( program[k] == 1 )
+                d--;
+            else
+            if( program[k] == 2 )
+                d++;
+        }
+        i = j;
+    }
+}
+
+// a value that isn't known at compile time.
+#define COW_UNKNOWN	INT_MIN
+
+// stands in for a mOO known to end the program.  Anything the interpreter
+// doesn't know ends the program too.
+#define COW_HALT	34
+
+// what is known about the tape and register at one point in the program.
+struct cow_cells
+{
+    bool reached;
+    bool zeros;     // cells not in known are still zero; otherwise unknown
+    int lo;         // the pointer is at least this many cells from the left end
+    int h;          // register flag (0 or 1) and value, or COW_UNKNOWN
+    int r;
+    int visits;
+    std::map<int, int> known;  // by offset from the pointer
+};
+
+inline int cow_get( const cow_cells& s, int off )
+{
+    std::map<int, int>::const_iterator it = s.known.find( off );
+    if( it != s.known.end() )
+        return it->second;
+    return s.zeros ? 0 : COW_UNKNOWN;
+}
+
+inline void cow_set( cow_cells& s, int off, int v )
+{
+    if( v == COW_UNKNOWN && !s.zeros )
+        s.known.erase( off );
+    else
+        s.known[off] = v;
+}
+
+inline void cow_shift( cow_cells& s, int by )
+{
+    std::map<int, int> moved;
+    for( std::map<int, int>::iterator it = s.known.begin(); it != s.known.end(); ++it )
+        moved[it->first - by] = it->second;
+    s.known.swap( moved );
+}
+
+// merge what reaches the same point from two places.  Returns whether into
+// lost anything.  Points seen too often forget the zeros and anything far
+// away, so loops settle.
+inline bool cow_join( cow_cells& into, const cow_cells& from )
+{
+    if( !into.reached )
+    {
+        into = from;
+        into.visits = 1;
+        return true;
+    }
+
+    cow_cells j;
+    j.reached = true;
+    j.zeros = into.zeros && from.zeros && into.visits < 8;
+    j.lo = std::min( into.lo, from.lo );
+    j.h = into.h == from.h ? into.h : COW_UNKNOWN;
+    j.r = into.r == from.r ? into.r : COW_UNKNOWN;
+    j.visits = into.visits + 1;
+
+    std::map<int, int>::const_iterator it;
+    for( it = into.known.begin(); it != into.known.end(); ++it )
+        if( cow_get( from, it->first ) == it->second )
+            cow_set( j, it->first, it->second );
+        else
+            cow_set( j, it->first, COW_UNKNOWN );
+    for( it = from.known.begin(); it != from.known.end(); ++it )
+        if( !into.known.count( it->first ) )
+            cow_set( j, it->first, cow_get( into, it->first ) == it->second ? it->second : COW_UNKNOWN );
+
+    if( j.known.size() > 64 )
+    {
+        j.zeros = false;
+        for( std::map<int, int>::iterator k = j.known.begin(); k != j.known.end(); )
+            if( k->second == COW_UNKNOWN || k->first < -8 || k->first > 8 )
+                j.known.erase( k++ );
+            else
+                ++k;
+    }
+
+    bool changed = j.zeros != into.zeros || j.lo != into.lo || j.h != into.h ||
+                   j.r != into.r || j.known != into.known;
+    into = j;
+    return changed;
+}
+
+// the effect of a command that doesn't jump, on the cell under the pointer.
+inline void cow_apply( cow_cells& s, int op )
+{
+    int v = cow_get( s, 0 );
+    switch( op )
+    {
+    case 2:
+        cow_shift( s, 1 );
+        s.lo++;
+        break;
+    case 4:
+        if( v == 0 || v == COW_UNKNOWN )
+            cow_set( s, 0, COW_UNKNOWN );
+        break;
+    case 5:
+    case 6:
+        if( v != COW_UNKNOWN )
+            cow_set( s, 0, (int)((unsigned)v + (op == 6 ? 1u : -1u)) );
+        break;
+    case 8:
+        cow_set( s, 0, 0 );
+        break;
+    case 9:
+        // either way the cell and the register end up equal.
+        if( s.h == 1 )
+            cow_set( s, 0, s.r );
+        else if( s.h == 0 )
+            s.r = v;
+        else
+        {
+            s.r = s.r == v ? v : COW_UNKNOWN;
+            cow_set( s, 0, s.r );
+        }
+        if( s.h != COW_UNKNOWN )
+            s.h = !s.h;
+        break;
+    case 11:
+        cow_set( s, 0, COW_UNKNOWN );
+        break;
+    }
+}
+
+// for each mOO, the command it always runs because the cell under the
+// pointer always holds the same value there, or COW_UNKNOWN.  Only mOO
+// entries are set.  commands is 12 for COW and 20 with DDX, whose
+// commands are taken to change anything, as they switch or move stomachs
+// or change all their cells.
+inline void cow_constants( const std::vector<int>& program, const std::vector<int>& moo_to,
+                           const std::vector<int>& MOO_to, int commands, std::vector<int>& known )
+{
+    int n = program.size();
+    known.assign( n, COW_UNKNOWN );
+    if( n == 0 )
+        return;
+
+    cow_cells none;
+    none.reached = false;
+    none.zeros = false;
+    none.lo = 0;
+    none.h = none.r = COW_UNKNOWN;
+    none.visits = 0;
+    std::vector<cow_cells> in( n, none );
+
+    cow_cells top = none;
+    top.reached = true;
+
+    cow_cells start = top;
+    start.zeros = true;
+    start.h = 0;
+    start.r = 0;
+
+    std::vector<int> work;
+    std::vector<bool> queued( n, false );
+    in[0] = start;
+    work.push_back( 0 );
+    queued[0] = true;
+
+    while( !work.empty() )
+    {
+        int i = work.back();
+        work.pop_back();
+        queued[i] = false;
+
+        const cow_cells s = in[i];
+        cow_cells next[2];
+        int to[2] = { -1, -1 };
+        int op = program[i];
+        int v = cow_get( s, 0 );
+
+        if( op == 3 )
+        {
+            // a known mOO is that command, apart from where it jumps.
+            if( v == COW_UNKNOWN )
+            {
+                next[0] = next[1] = top;
+                to[0] = i + 1;
+                to[1] = moo_to[i];
+            }
+            else if( v == 0 )
+            {
+                next[0] = s;
+                to[0] = moo_to[i] >= 0 ? moo_to[i] : i + 1;
+            }
+            else if( v == 7 )
+            {
+                next[0] = s;
+                to[0] = i + 1;
+            }
+            else if( v >= 0 && v < commands && v != 3 )
+                op = v;
+        }
+
+        if( op != 3 )
+        {
+            switch( op )
+            {
+            case 0:
+                next[0] = s;
+                to[0] = moo_to[i];
+                break;
+
+            // with the pointer maybe at the left end, mOo might not move.
+            case 1:
+                next[0] = s;
+                cow_shift( next[0], -1 );
+                next[0].lo = std::max( s.lo - 1, 0 );
+                to[0] = i + 1;
+                if( s.lo == 0 )
+                {
+                    next[1] = s;
+                    to[1] = i + 1;
+                }
+                break;
+
+            case 7:
+                if( MOO_to[i] < 0 )
+                    break;
+                if( MOO_to[i] == n || v != 0 )
+                {
+                    next[0] = s;
+                    to[0] = i + 1;
+                }
+                if( MOO_to[i] < n && (v == 0 || v == COW_UNKNOWN) )
+                {
+                    next[1] = s;
+                    cow_set( next[1], 0, 0 );
+                    to[1] = MOO_to[i] + 1;
+                }
+                break;
+
+            default:
+                next[0] = op >= 12 ? top : s;
+                cow_apply( next[0], op );
+                to[0] = i + 1;
+                break;
+            }
+        }
+
+        for( int k = 0; k < 2; k++ )
+            if( to[k] >= 0 && to[k] < n && cow_join( in[to[k]], next[k] ) && !queued[to[k]] )
+            {
+                queued[to[k]] = true;
+                work.push_back( to[k] );
+            }
+    }
+
+    for( int i = 0; i < n; i++ )
+        if( program[i] == 3 && in[i].reached )
+            known[i] = cow_get( in[i], 0 );
+}
+
+// program with each mOO whose command is known and isn't a bracket (which
+// would throw off the scans) replaced by that command, or by COW_HALT if
+// it ends the program.  commands is as for cow_constants().
+inline void cow_devirt( const std::vector<int>& program, const std::vector<int>& known, int commands,
+                        std::vector<int>& out )
+{
+    out = program;
+    for( size_t i = 0; i < out.size(); i++ )
+    {
+        int c = known[i];
+        if( program[i] != 3 || c == COW_UNKNOWN || c == 0 || c == 7 )
+            continue;
+        out[i] = c >= 0 && c < commands && c != 3 ? c : COW_HALT;
+    }
+}
+
+// most cells a closed form loop may touch, and the fewest passes worth
+// working out a matrix power for.
+#define COW_CELLS	16
+#define COW_MIN_TRIPS	32
+
+// a loop whose pass is a fixed linear map (mod 2^32) of the cells it
+// touches, with the cell under the pointer stepping by an odd constant.
+// It runs (0 - cell) * step^-1 times, so it can be done in one go: each
+// cell plus a constant times that when affine, a matrix power otherwise.
+struct cow_counted
+{
+    int end;                    // the moo closing it, or -1
+    unsigned step;
+    unsigned inv;               // step^-1 mod 2^32
+    bool affine;
+    std::vector<int> cells;     // offsets from the control cell; cells[0] is 0
+    std::vector<unsigned> map;  // (k+1) x (k+1), row major, last column and row for constants
+};
+
+// a linear expression over the cells at loop entry.
+typedef std::vector<unsigned> cow_expr;
+
+// the row of value for the cell at offset off, adding it as the identity
+// if it is new.  -1 once there are too many.
+inline int cow_row( cow_counted& c, std::vector<cow_expr>& value, int off )
+{
+    for( size_t k = 0; k < c.cells.size(); k++ )
+        if( c.cells[k] == off )
+            return k;
+    if( c.cells.size() == COW_CELLS )
+        return -1;
+    c.cells.push_back( off );
+    for( size_t k = 0; k < value.size(); k++ )
+        value[k].insert( value[k].end() - 1, 0u );
+    int k = c.cells.size() - 1;
+    cow_expr e( k + 2, 0u );
+    e[k] = 1;
+    value.push_back( e );
+    return k;
+}
+
+// the map one pass of loop i makes, or false if it isn't linear.  Inner
+// loops must be affine: anything else isn't linear in the cells, and
+// neither are I/O, the register or the DDX commands.
+inline bool cow_pass( const std::vector<int>& program, const std::vector<int>& other,
+                      const std::vector<cow_counted>& loops, int i, cow_counted& c )
+{
+    int j = other[i];
+    std::vector<cow_expr> value;
+    c.cells.assign( 1, 0 );
+    c.affine = true;
+
+    value.push_back( cow_expr( 2, 0u ) );
+    value[0][0] = 1;
+
+    int d = 0;
+    for( int k = i + 1; k < j; k++ )
+    {
+        int op = program[k];
+        if( op == 1 || op == 2 )
+        {
+            d += op == 2 ? 1 : -1;
+            continue;
+        }
+
+        int at = cow_row( c, value, d );
+        if( at < 0 )
+            return false;
+
+        if( op == 5 || op == 6 )
+            value[at].back() += op == 6 ? 1u : -1u;
+        else if( op == 8 )
+        {
+            value[at].assign( value[at].size(), 0u );
+            c.affine = false;
+        }
+        else if( op == 7 && loops[k].end >= 0 && loops[k].affine )
+        {
+            // trips = -inv * control, then each cell gets add * trips.
+            // Every cell goes in first, as adding one widens the rows.
+            const cow_counted& in = loops[k];
+            int m = in.cells.size();
+            for( int l = 1; l < m; l++ )
+                if( cow_row( c, value, d + in.cells[l] ) < 0 )
+                    return false;
+            cow_expr trips = value[at];
+            for( size_t t = 0; t < trips.size(); t++ )
+                trips[t] *= 0u - in.inv;
+            for( int l = 1; l < m; l++ )
+            {
+                int to = cow_row( c, value, d + in.cells[l] );
+                unsigned add = in.map[l * (m + 1) + m];
+                for( size_t t = 0; t < trips.size(); t++ )
+                    value[to][t] += add * trips[t];
+            }
+            value[at].assign( value[at].size(), 0u );
+            c.affine = false;
+            k = other[k];
+        }
+        else
+            return false;
+    }
+    if( d != 0 )
+        return false;
+
+    // the control cell may only step by a constant.
+    int n = c.cells.size();
+    for( int k = 0; k < n; k++ )
+        if( value[0][k] != (k == 0 ? 1u : 0u) )
+            return false;
+    c.step = value[0][n];
+    if( (c.step & 1) == 0 )
+        return false;
+
+    // Newton's iteration doubles the correct low bits each time.
+    c.inv = c.step;
+    for( int k = 0; k < 5; k++ )
+        c.inv *= 2u - c.step * c.inv;
+
+    c.map.assign( (n + 1) * (n + 1), 0u );
+    for( int r = 0; r < n; r++ )
+    {
+        for( int k = 0; k <= n; k++ )
+            c.map[r * (n + 1) + k] = value[r][k];
+        for( int k = 0; k < n; k++ )
+            if( value[r][k] != (r == k ? 1u : 0u) )
+                c.affine = false;
+    }
+    c.map[n * (n + 1) + n] = 1;
+    return true;
+}
+
+// find the loops that can run in closed form, among the loops from
+// cow_loops().  loops[i].end is -1 for everything else.
+inline void cow_counted_loops( const std::vector<int>& program, const std::vector<int>& other,
+                               std::vector<cow_counted>& loops )
+{
+    int n = program.size();
+    cow_counted none;
+    none.end = -1;
+    none.step = none.inv = 0;
+    none.affine = false;
+    loops.assign( n, none );
+
+    // inner loops first.
+    for( int i = n - 1; i >= 0; i-- )
+    {
+        if( program[i] != 7 || other[i] < 0 )
+            continue;
+        cow_counted c = none;
+        if( cow_pass( program, other, loops, i, c ) )
+        {
+            c.end = other[i];
+            loops[i] = c;
+        }
+    }
+}
+
+// how many passes a counted loop makes when its control cell is v.
+inline unsigned cow_trips( const cow_counted& c, int v )
+{
+    return (0u - (unsigned)v) * c.inv;
+}
+
+// run a counted loop on the cells around cell, the control cell, on a
+// tape whose cells are pitch ints apart.  Returns false, having changed
+// nothing, when so few passes are due that running the loop is quicker.
+inline bool cow_close( const cow_counted& c, int* cell, int pitch = 1 )
+{
+    unsigned trips = cow_trips( c, *cell );
+    int k = c.cells.size();
+    int n = k + 1;
+
+    if( c.affine )
+    {
+        for( int i = 1; i < k; i++ )
+            cell[c.cells[i] * pitch] = (int)((unsigned)cell[c.cells[i] * pitch] + c.map[i * n + k] * trips);
+        *cell = 0;
+        return true;
+    }
+    if( trips < COW_MIN_TRIPS )
+        return false;
+
+    // powers of the same matrix commute, so squaring in any order works.
+    unsigned v[COW_CELLS + 1], w[COW_CELLS + 1];
+    unsigned b[(COW_CELLS + 1) * (COW_CELLS + 1)], s[(COW_CELLS + 1) * (COW_CELLS + 1)];
+    for( int i = 0; i < k; i++ )
+        v[i] = cell[c.cells[i] * pitch];
+    v[k] = 1;
+    std::copy( c.map.begin(), c.map.end(), b );
+    for( ; trips; trips >>= 1 )
+    {
+        if( trips & 1 )
+        {
+            for( int i = 0; i < n; i++ )
+            {
+                unsigned a = 0;
+                for( int j = 0; j < n; j++ )
+                    a += b[i * n + j] * v[j];
+                w[i] = a;
+            }
+            std::copy( w, w + n, v );
+        }
+        for( int i = 0; i < n; i++ )
+            for( int j = 0; j < n; j++ )
+            {
+                unsigned a = 0;
+                for( int l = 0; l < n; l++ )
+                    a += b[i * n + l] * b[l * n + j];
+                s[i * n + j] = a;
+            }
+        std::copy( s, s + n * n, b );
+    }
+    for( int i = 0; i < k; i++ )
+        cell[c.cells[i] * pitch] = (int)v[i];
+    return true;
+}
+
+// a run of moves and adds inside a region whose adds span at least
+// COW_WIDE cells, done as one vector of additions to the cells from lo
+// and then one move.  The interpreter marks its first command COW_ADDS.
+#define COW_ADDS	35
+#define COW_WIDE	4
+
+struct cow_block
+{
+    int len;                // commands in the run, 0 if none starts here
+    int lo;                 // first cell added to, from the pointer
+    int move;
+    std::vector<int> add;   // for each cell from lo on
+};
+
+// find the runs, using head from cow_regions().  A run can't cross into or
+// out of a region, as those start and end with brackets, and any other
+// command (DDX ones too) ends it.
+inline void cow_blocks( const std::vector<int>& program, const std::vector<int>& head,
+                        std::vector<cow_block>& blocks )
+{
+    int n = program.size();
+    cow_block none;
+    none.len = none.lo = none.move = 0;
+    blocks.assign( n, none );
+
+    for( int i = 0; i < n; )
+    {
+        int j = i;
+        while( j < n && head[j] >= 0 &&
+               (program[j] == 1 || program[j] == 2 || program[j] == 5 || program[j] == 6) )
+            j++;
+        if( j == i )
+        {
+            i++;
+            continue;
+        }
+
+        std::map<int,int> add;
+        int d = 0;
+        for( int k = i; k < j; k++ )
+            if( program[k] == 1 || program[k] == 2 )
+                d += program[k] == 2 ? 1 : -1;
+            else
+                add[d] += program[k] == 6 ? 1 : -1;
+
+        // cells that end up the same don't count.
+        for( std::map<int,int>::iterator it = add.begin(); it != add.end(); )
+            if( it->second == 0 )
+                add.erase( it++ );
+            else
+                ++it;
+
+        if( !add.empty() && add.rbegin()->first - add.begin()->first + 1 >= COW_WIDE )
+        {
+            cow_block& b = blocks[i];
+            b.len = j - i;
+            b.lo = add.begin()->first;
+            b.move = d;
+            b.add.assign( add.rbegin()->first - b.lo + 1, 0 );
+            for( std::map<int,int>::iterator it = add.begin(); it != add.end(); ++it )
+                b.add[it->first - b.lo] = it->second;
+        }
+        i = j;
+    }
+}
+
+// add n values from add to the cells from c on, pitch ints apart,
+// wrapping around.
+inline void cow_add( int* c, const int* add, int n, int pitch = 1 )
+{
+    int i = 0;
+    if( pitch != 1 )
+    {
+        for( ; i < n; i++ )
+            c[i * pitch] = (int)((unsigned)c[i * pitch] + (unsigned)add[i]);
+        return;
+    }
+#ifdef __AVX2__
+    for( ; i + 8 <= n; i += 8 )
+    {
+        __m256i v = _mm256_loadu_si256( (const __m256i*)(c + i) );
+        v = _mm256_add_epi32( v, _mm256_loadu_si256( (const __m256i*)(add + i) ) );
+        _mm256_storeu_si256( (__m256i*)(c + i), v );
+    }
+#endif
+#ifdef __SSE2__
+    for( ; i + 4 <= n; i += 4 )
+    {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(c + i) );
+        v = _mm_add_epi32( v, _mm_loadu_si128( (const __m128i*)(add + i) ) );
+        _mm_storeu_si128( (__m128i*)(c + i), v );
+    }
+#endif
+    for( ; i < n; i++ )
+        c[i] = (int)((unsigned)c[i] + (unsigned)add[i]);
+}
+
+// loops that only move the pointer, all in one direction: scans[i] is how
+// far each pass of the loop at i goes, or 0.
+inline void cow_scans( const std::vector<int>& program, const std::vector<int>& other,
+                       std::vector<int>& scans )
+{
+    int n = program.size();
+    scans.assign( n, 0 );
+    for( int i = 0; i < n; i++ )
+    {
+        int j = other[i];
+        if( program[i] != 7 || j <= i + 1 )
+            continue;
+        int k = i + 1;
+        while( k < j && program[k] == program[i + 1] && (program[k] == 1 || program[k] == 2) )
+            k++;
+        if( k == j )
+            scans[i] = program[i + 1] == 2 ? j - i - 1 : i + 1 - j;
+    }
+}
+
+// which of COW_LANES cells from c on are zero, as a bit mask.
+#if defined(__AVX2__)
+#define COW_LANES	8
+inline int cow_zeros( const int* c )
+{
+    __m256i v = _mm256_loadu_si256( (const __m256i*)c );
+    return _mm256_movemask_ps( _mm256_castsi256_ps( _mm256_cmpeq_epi32( v, _mm256_setzero_si256() ) ) );
+}
+#elif defined(__SSE2__)
+#define COW_LANES	4
+inline int cow_zeros( const int* c )
+{
+    __m128i v = _mm_loadu_si128( (const __m128i*)c );
+    return _mm_movemask_ps( _mm_castsi128_ps( _mm_cmpeq_epi32( v, _mm_setzero_si128() ) ) );
+}
+#else
+#define COW_LANES	1
+inline int cow_zeros( const int* c )
+{
+    return *c == 0;
+}
+#endif
+
+// run a scan loop from the nonzero cell at in the n cells of m, cell i
+// being m[i * pitch]: the first zero cell stride, 2 * stride, ... cells
+// away.  Returns false if it would leave the tape first, with at on the
+// last cell it reached.
+//
+// Strides up to COW_LANES on a packed tape check a whole vector of cells
+// at a time.  Each one starts on a cell the loop stops at, so the lanes to
+// look at are the same every time.
+inline bool cow_scan( const int* m, long n, long& at, int stride, int pitch = 1 )
+{
+    int w = stride < 0 ? -stride : stride;
+    long i = at + stride;
+    if( w <= COW_LANES && pitch == 1 )
+    {
+        int lanes = 0;
+        for( int l = 0; l < COW_LANES; l += w )
+            lanes |= stride > 0 ? 1 << l : 1 << (COW_LANES - 1 - l);
+        long step = (COW_LANES + w - 1) / w * w;
+
+        if( stride > 0 )
+            for( ; i + COW_LANES <= n; i += step )
+            {
+                int z = cow_zeros( m + i ) & lanes;
+                if( z )
+                {
+                    at = i + __builtin_ctz( z );
+                    return true;
+                }
+            }
+        else
+            for( ; i - COW_LANES + 1 >= 0; i -= step )
+            {
+                int z = cow_zeros( m + i - COW_LANES + 1 ) & lanes;
+                if( z )
+                {
+                    at = i - COW_LANES + 1 + 31 - __builtin_clz( z );
+                    return true;
+                }
+            }
+    }
+
+    for( ; i >= 0 && i < n; i += stride )
+        if( m[i * pitch] == 0 )
+        {
+            at = i;
+            return true;
+        }
+    at = i - stride;
+    return false;
+}
+
+// DDX: the stomach each command starts in, where it is always the same,
+// else -1 (or -2 where nothing gets to).  Only MMm and MmM change it, and
+// a mOO may run either, so after one it is lost.  The program starts in
+// stomach 0 of stomachs.
+inline void cow_stomachs( const std::vector<int>& program, const std::vector<int>& moo_to,
+                          const std::vector<int>& MOO_to, int stomachs, std::vector<int>& at )
+{
+    int n = program.size();
+    at.assign( n, -2 );
+    if( n == 0 )
+        return;
+
+    std::vector<int> work;
+    at[0] = 0;
+    work.push_back( 0 );
+    while( !work.empty() )
+    {
+        int i = work.back();
+        work.pop_back();
+
+        int op = program[i];
+        int s = at[i];
+        if( op == 3 )
+            s = -1;
+        else
+        if( op == 12 && s >= 0 )
+            s = s == 0 ? stomachs - 1 : s - 1;
+        else
+        if( op == 13 && s >= 0 )
+            s = s == stomachs - 1 ? 0 : s + 1;
+
+        // moo goes back to its MOO, MOO on past its moo, a mOO maybe both.
+        int next[3] = { i + 1, -1, -1 };
+        if( op == 0 )
+            next[0] = moo_to[i];
+        if( op == 3 )
+            next[1] = moo_to[i];
+        if( (op == 7 || op == 3) && MOO_to[i] >= 0 )
+            next[2] = MOO_to[i] + 1;
+
+        for( int k = 0; k < 3; k++ )
+        {
+            int t = next[k];
+            if( t < 0 || t >= n || at[t] == s || at[t] == -1 )
+                continue;
+            at[t] = at[t] == -2 ? s : -1;
+            work.push_back( t );
+        }
+    }
+}
+
+#endif